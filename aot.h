@@ -0,0 +1,21 @@
+#ifndef aot_h
+#define aot_h
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Interface of the C file emu-recomp generates from a rom (make emu-aot).
+// Every basic block of the rom's index (emu-analyze, blockindex.h) is a
+// C function built from cpu_ops.h, so it behaves exactly like exec().
+// A block checks its bytes on entry and refuses to run if the guest has
+// modified them. That pc, and any pc that isn't a block start (PCHL
+// targets, RAM), goes through exec() one instruction at a time.
+
+extern const char aot_rom[]; // what the code was generated from
+extern const uint32_t aot_rom_crc32;
+extern const uint16_t aot_base_addr;
+
+// Like run() without stop conditions, the budget is checked between blocks
+run_reason aot_run(CPU* cpu, const uint64_t cycles);
+
+#endif
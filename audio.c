@@ -0,0 +1,39 @@
+#include <SDL2/SDL.h>
+#include "audio.h"
+
+#define AUDIO_BUFFER_SAMPLES 512 // ~11.6ms at 44.1kHz, below one frame
+
+SDL_AudioDeviceID audio_device;
+
+// Runs on SDL's audio thread, sound_mix() only touches the mixer side.
+void audio_callback(void *userdata, Uint8 *stream, int len) {
+    sound_mix(userdata, (int16_t*) stream, len / sizeof(int16_t));
+}
+
+bool init_audio(sound *s) {
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        return false;
+    }
+
+    SDL_AudioSpec want = {
+        .freq = SOUND_SAMPLE_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = AUDIO_BUFFER_SAMPLES,
+        .callback = audio_callback,
+        .userdata = s,
+    };
+    audio_device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (audio_device == 0) {
+        return false;
+    }
+    SDL_PauseAudioDevice(audio_device, 0);
+    return true;
+}
+
+void destroy_audio() {
+    if (audio_device != 0) {
+        SDL_CloseAudioDevice(audio_device);
+        audio_device = 0;
+    }
+}
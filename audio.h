@@ -0,0 +1,5 @@
+#include <stdbool.h>
+#include "sound.h"
+
+bool init_audio(sound *s);
+void destroy_audio();
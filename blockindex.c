@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "blockindex.h"
+#include "opcodes.h"
+
+#define QUEUED 0x80 // on the work list
+
+#define PAGE 0x1000
+#define SPACE 0x10000 // addresses
+
+typedef struct {
+    const uint8_t *mem;
+    uint32_t start, end;
+    uint8_t *marks;
+    uint16_t *work;
+    int n;
+    uint8_t phase; // 0, or WALK_TRACED for the observed pcs
+} walk;
+
+static bool in_rom(const walk *w, const uint32_t addr) {
+    return addr >= w->start && addr < w->end;
+}
+
+static void lead(walk *w, const uint16_t addr) {
+    if (!in_rom(w, addr)) return;
+    if (!(w->marks[addr] & WALK_LEADER)) {
+        w->marks[addr] |= WALK_LEADER | w->phase;
+    }
+    if (!(w->marks[addr] & QUEUED)) {
+        w->marks[addr] |= QUEUED;
+        w->work[w->n++] = addr;
+    }
+}
+
+int block_target(const uint8_t *mem, const uint16_t pc) {
+    const uint8_t op = mem[pc];
+    switch (opcodes[op].flow) {
+        case FLOW_JUMP:
+        case FLOW_JUMP_COND:
+        case FLOW_CALL:
+        case FLOW_CALL_COND:
+            return (mem[pc + 2] << 8) | mem[pc + 1];
+        case FLOW_RST:
+            return op & 0x38;
+        default:
+            return -1;
+    }
+}
+
+static void descend(walk *w) {
+    while (w->n > 0) {
+        uint32_t a = w->work[--w->n];
+        bool fell = false; // through from the instruction before
+        while (in_rom(w, a)) {
+            if (w->marks[a] & WALK_START) {
+                // code walked before, two paths meet here
+                if (fell && !(w->marks[a] & WALK_LEADER)) {
+                    w->marks[a] |= WALK_LEADER | w->phase;
+                }
+                break;
+            }
+            const op_info *info = &opcodes[w->mem[a]];
+            if (info->flow == FLOW_INVALID) break;
+            w->marks[a] |= WALK_START;
+            for (uint32_t i = a; i < a + info->length && i < w->end; i++) {
+                w->marks[i] |= WALK_CODE;
+            }
+
+            const int target = block_target(w->mem, a);
+            if (target >= 0) {
+                w->marks[target] |= WALK_TARGET;
+                lead(w, target);
+            }
+
+            const uint32_t next = a + info->length;
+            if (info->flow == FLOW_NEXT) {
+                a = next;
+                fell = true;
+                continue;
+            }
+            // calls and conditionals come back, HLT goes on after an interrupt
+            if (info->flow != FLOW_JUMP && info->flow != FLOW_RET && info->flow != FLOW_INDIRECT) {
+                lead(w, next);
+            }
+            break;
+        }
+    }
+}
+
+void block_walk(uint8_t *marks, const uint8_t *mem, uint32_t start, uint32_t end,
+        const uint16_t *entries, int num_entries, const uint8_t *observed) {
+    walk w = {
+        .mem = mem,
+        .start = start,
+        .end = end < SPACE ? end : SPACE,
+        .marks = marks,
+        .work = malloc(SPACE * sizeof(uint16_t)),
+    };
+
+    for (int i = 0; i < num_entries; i++) {
+        lead(&w, entries[i]);
+    }
+    descend(&w);
+    if (observed) {
+        w.phase = WALK_TRACED;
+        // only where nothing led yet, in order so a straight line seen
+        // running is one block and not one per pc
+        for (uint32_t a = w.start; a < w.end; a++) {
+            if (observed[a] && !(w.marks[a] & WALK_START)) {
+                lead(&w, a);
+                descend(&w);
+            }
+        }
+    }
+    free(w.work);
+}
+
+// The block from a leader on, up to the next leader or whatever leaves it
+static block_entry make_block(const uint8_t *marks, const uint8_t *mem, const uint32_t end, const uint32_t start) {
+    block_entry b = { .start = start };
+    uint32_t a = start, last;
+    for (;;) {
+        last = a;
+        b.instructions++;
+        a += opcodes[mem[last]].length;
+        if (opcodes[mem[last]].flow != FLOW_NEXT || a >= end || !(marks[a] & WALK_START)
+                || (marks[a] & WALK_LEADER)) break;
+    }
+    b.length = a - start;
+
+    const int target = block_target(mem, last);
+    switch (opcodes[mem[last]].flow) {
+        case FLOW_JUMP:
+            b.succ[b.num_succ++] = target;
+            break;
+        case FLOW_CALL:
+        case FLOW_CALL_COND:
+        case FLOW_RST:
+            b.flags |= BLOCK_CALL;
+            // fall through
+        case FLOW_JUMP_COND:
+            b.succ[b.num_succ++] = target;
+            b.succ[b.num_succ++] = a;
+            break;
+        case FLOW_RET_COND:
+            b.succ[b.num_succ++] = a;
+            // fall through
+        case FLOW_RET:
+        case FLOW_INDIRECT:
+            b.flags |= BLOCK_INDIRECT;
+            break;
+        default:
+            b.succ[b.num_succ++] = a;
+    }
+    if (marks[start] & WALK_TRACED) {
+        b.flags |= BLOCK_TRACED;
+    }
+    return b;
+}
+
+bool block_index_write(const char *path, const uint8_t *mem, uint16_t base_addr, uint32_t size, uint32_t rom_crc32,
+        const uint16_t *entries, int num_entries, const uint8_t *observed) {
+    const uint32_t end = base_addr + size < SPACE ? base_addr + size : SPACE;
+    size = end - base_addr;
+    uint8_t *marks = calloc(SPACE, 1);
+    block_walk(marks, mem, base_addr, end, entries, num_entries, observed);
+
+    const size_t bitmap_size = (size + 7) / 8;
+    block_entry *blocks = malloc(size * sizeof(block_entry));
+    uint8_t *code = calloc(bitmap_size, 1);
+    uint8_t *starts = calloc(bitmap_size, 1);
+    block_index_header h = { .rom_crc32 = rom_crc32, .rom_size = size, .base_addr = base_addr };
+    memcpy(h.magic, BLOCKS_MAGIC, sizeof(h.magic));
+
+    for (uint32_t a = base_addr; a < end; a++) {
+        const uint32_t offset = a - base_addr;
+        if (marks[a] & WALK_CODE) {
+            code[offset >> 3] |= 1 << (offset & 7);
+            h.code_bytes++;
+        }
+        if (marks[a] & WALK_START) {
+            starts[offset >> 3] |= 1 << (offset & 7);
+            h.instructions++;
+            if (marks[a] & WALK_LEADER) {
+                blocks[h.num_blocks++] = make_block(marks, mem, end, a);
+            }
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    bool ok = f != NULL
+        && fwrite(&h, sizeof(h), 1, f) == 1
+        && fwrite(blocks, sizeof(block_entry), h.num_blocks, f) == h.num_blocks
+        && fwrite(code, 1, bitmap_size, f) == bitmap_size
+        && fwrite(starts, 1, bitmap_size, f) == bitmap_size;
+    if (f && fclose(f) != 0) ok = false;
+
+    free(starts);
+    free(code);
+    free(blocks);
+    free(marks);
+    return ok;
+}
+
+block_index* block_index_open(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(block_index_header)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const block_index_header *h = map;
+    const size_t bitmap_size = (h->rom_size + 7) / 8;
+    if (memcmp(h->magic, BLOCKS_MAGIC, sizeof(h->magic)) != 0
+            || (size_t) st.st_size != sizeof(*h) + h->num_blocks * sizeof(block_entry) + 2 * bitmap_size) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    block_index *idx = malloc(sizeof(block_index));
+    idx->header = h;
+    idx->blocks = (const block_entry*) (h + 1);
+    idx->code = (const uint8_t*) (idx->blocks + h->num_blocks);
+    idx->starts = idx->code + bitmap_size;
+    idx->map_size = st.st_size;
+    return idx;
+}
+
+void block_index_close(block_index *idx) {
+    munmap((void*) idx->header, idx->map_size);
+    free(idx);
+}
+
+const block_entry* block_index_find(const block_index *idx, const uint16_t addr) {
+    // the last block starting at or before addr
+    uint32_t lo = 0, hi = idx->header->num_blocks;
+    while (lo < hi) {
+        const uint32_t mid = (lo + hi) / 2;
+        if (idx->blocks[mid].start <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return NULL;
+    const block_entry *b = &idx->blocks[lo - 1];
+    return addr - b->start < b->length ? b : NULL;
+}
+
+int block_index_prewarm(const block_index *idx, const uint8_t *mem) {
+    const uint32_t base = idx->header->base_addr;
+    int pages = 0;
+    volatile uint8_t sink = 0;
+    for (uint32_t page = base & ~(PAGE - 1); page < base + idx->header->rom_size; page += PAGE) {
+        for (uint32_t a = page > base ? page : base; a < page + PAGE && a < base + idx->header->rom_size; a++) {
+            if (block_index_code(idx, a)) {
+                sink += mem[a];
+                pages++;
+                break;
+            }
+        }
+    }
+    (void) sink;
+    return pages;
+}
@@ -0,0 +1,98 @@
+#ifndef blockindex_h
+#define blockindex_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Which bytes of a rom are code and where its basic blocks are, found
+// offline (emu-analyze) and written as a file that's mmap'ed as is.
+//
+// Control flow is followed from entry points: the reset and interrupt
+// vectors, addresses given by hand, and every pc an execution trace saw.
+// A block starts at an entry, at a branch target, after anything that
+// branches, calls or returns, and where two paths meet. RET and PCHL go
+// where only running the code can tell, their blocks are marked indirect,
+// a trace is what finds the code they lead to.
+//
+// The file is the header, the blocks sorted by start, then two bitmaps
+// with a bit per rom byte from base_addr: every byte of an instruction,
+// and the bytes an instruction starts at. Little endian, naturally aligned.
+
+#define BLOCKS_MAGIC "8080BLK1"
+
+#define BLOCK_INDIRECT 0x01 // ends in RET, Rcc or PCHL
+#define BLOCK_CALL     0x02 // ends in CALL, Ccc or RST, succ[1] is where it returns to
+#define BLOCK_TRACED   0x04 // only the trace's pcs lead here
+
+typedef struct {
+    char magic[8];
+    uint32_t rom_crc32;
+    uint32_t rom_size; // bytes from base_addr the bitmaps cover
+    uint16_t base_addr;
+    uint16_t reserved;
+    uint32_t num_blocks;
+    uint32_t instructions;
+    uint32_t code_bytes;
+} block_index_header;
+
+typedef struct {
+    uint16_t start;
+    uint16_t length; // bytes
+    uint16_t instructions;
+    uint16_t succ[2]; // the branch target first, then the fall through
+    uint8_t num_succ;
+    uint8_t flags; // BLOCK_*
+} block_entry;
+
+_Static_assert(sizeof(block_index_header) == 32, "the file layout");
+_Static_assert(sizeof(block_entry) == 12, "the file layout");
+
+typedef struct {
+    const block_index_header *header;
+    const block_entry *blocks;
+    const uint8_t *code;
+    const uint8_t *starts;
+    size_t map_size;
+} block_index;
+
+// The recursive descent everything that needs to know what's code uses:
+// the index, emu-disass -r and, through the index, emu-recomp. marks holds
+// a byte per address (64K, zeroed), the walk sets these in it for
+// [start, end), WALK_TARGET for any address. The top bit is its own.
+#define WALK_CODE   0x01 // a byte of an instruction
+#define WALK_START  0x02 // an instruction starts here
+#define WALK_LEADER 0x04 // a block starts here
+#define WALK_TARGET 0x08 // a JMP/Jcc/CALL/Ccc/RST goes here
+#define WALK_TRACED 0x10 // a leader found from the observed pcs only
+
+void block_walk(uint8_t *marks, const uint8_t *mem, uint32_t start, uint32_t end,
+    const uint16_t *entries, int num_entries, const uint8_t *observed);
+
+// Where the JMP/Jcc/CALL/Ccc/RST at pc goes, -1 for everything else
+int block_target(const uint8_t *mem, uint16_t pc);
+
+// Analyzes mem[base_addr, base_addr + size) (MEM_SIZE + 2 readable) from
+// the entries and, when it isn't NULL, every address observed[addr] is
+// set for. Writes the index to path.
+bool block_index_write(const char *path, const uint8_t *mem, uint16_t base_addr, uint32_t size, uint32_t rom_crc32,
+    const uint16_t *entries, int num_entries, const uint8_t *observed);
+
+// NULL when path isn't an index
+block_index* block_index_open(const char *path);
+void block_index_close(block_index *idx);
+
+// The block addr is in, NULL when it isn't in any
+const block_entry* block_index_find(const block_index *idx, uint16_t addr);
+
+// Reads a byte of every page of mem that holds code, so the rom's pages are
+// mapped before the first frame instead of faulting in during it. Returns
+// how many pages that was.
+int block_index_prewarm(const block_index *idx, const uint8_t *mem);
+
+static inline bool block_index_code(const block_index *idx, const uint16_t addr) {
+    const uint32_t offset = (uint16_t) (addr - idx->header->base_addr);
+    return offset < idx->header->rom_size && (idx->code[offset >> 3] >> (offset & 7)) & 1;
+}
+
+#endif
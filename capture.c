@@ -0,0 +1,254 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+#include "rom.h"
+#include "screen.h"
+
+#define ROW_BYTES (CAPTURE_WIDTH / 8)
+#define SCREEN_BYTES (ROW_BYTES * CAPTURE_HEIGHT)
+#define CHROMA_BYTES (CAPTURE_WIDTH / 2 * CAPTURE_HEIGHT / 2)
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 8 gray pixels for every byte of screen_rows()
+static void gray_lut(uint64_t *lut, const uint8_t off, const uint8_t on) {
+    for (int v = 0; v < 256; v++) {
+        uint8_t px[8];
+        for (int k = 0; k < 8; k++) {
+            px[k] = v & (0x80 >> k) ? on : off;
+        }
+        memcpy(&lut[v], px, 8);
+    }
+}
+
+static void to_gray(const uint8_t *rows, uint8_t *gray, const uint64_t *lut) {
+    for (int i = 0; i < SCREEN_BYTES; i++) {
+        memcpy(&gray[i * 8], &lut[rows[i]], 8);
+    }
+}
+
+static void put32(uint8_t *p, const uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool png_chunk(FILE *f, const char *type, const uint8_t *data, const uint32_t len) {
+    static uint8_t buf[8 + SCREEN_BYTES + CAPTURE_HEIGHT + 64];
+    put32(buf, len);
+    memcpy(&buf[4], type, 4);
+    if (len) memcpy(&buf[8], data, len);
+    put32(&buf[8 + len], crc32(&buf[4], len + 4));
+    return fwrite(buf, len + 12, 1, f) == 1;
+}
+
+// 1 bit gray PNG, the image data as a single stored deflate block
+static bool write_png(const char *path, const uint8_t *rows) {
+    static uint8_t idat[2 + 5 + (ROW_BYTES + 1) * CAPTURE_HEIGHT + 4];
+    uint8_t *p = idat;
+    *p++ = 0x78; // zlib, 32K window, no compression
+    *p++ = 0x01;
+    const uint16_t len = (ROW_BYTES + 1) * CAPTURE_HEIGHT;
+    *p++ = 0x01; // final stored block
+    *p++ = len & 0xff;
+    *p++ = len >> 8;
+    *p++ = ~len & 0xff;
+    *p++ = (uint16_t) ~len >> 8;
+
+    uint32_t a = 1, b = 0; // adler32 of the raw data
+    for (int y = 0; y < CAPTURE_HEIGHT; y++) {
+        *p++ = 0; // no filter
+        memcpy(p, &rows[y * ROW_BYTES], ROW_BYTES);
+        p += ROW_BYTES;
+    }
+    for (const uint8_t *d = &idat[7]; d < p; d++) {
+        a = (a + *d) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(p, (b << 16) | a);
+    p += 4;
+
+    uint8_t ihdr[13];
+    put32(ihdr, CAPTURE_WIDTH);
+    put32(&ihdr[4], CAPTURE_HEIGHT);
+    ihdr[8] = 1; // bit depth
+    ihdr[9] = 0; // gray
+    ihdr[10] = ihdr[11] = ihdr[12] = 0; // deflate, no filter method, no interlace
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    bool ok = fwrite("\x89PNG\r\n\x1a\n", 8, 1, f) == 1;
+    ok = ok && png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    ok = ok && png_chunk(f, "IDAT", idat, p - idat);
+    ok = ok && png_chunk(f, "IEND", NULL, 0);
+    return fclose(f) == 0 && ok;
+}
+
+static void encode(capture *c, const capture_slot *slot, uint8_t *rows, uint8_t *gray, const uint8_t *chroma,
+        const uint64_t *lut) {
+    screen_rows(slot->vram, rows);
+    if (c->video) {
+        bool ok;
+        to_gray(rows, gray, lut);
+        if (c->y4m) {
+            ok = fwrite("FRAME\n", 6, 1, c->video) == 1;
+            ok = ok && fwrite(gray, CAPTURE_WIDTH * CAPTURE_HEIGHT, 1, c->video) == 1;
+            ok = ok && fwrite(chroma, CHROMA_BYTES * 2, 1, c->video) == 1;
+        } else {
+            ok = fwrite(gray, CAPTURE_WIDTH * CAPTURE_HEIGHT, 1, c->video) == 1;
+        }
+        if (!ok) {
+            perror("capture write");
+            c->failed = true;
+            return;
+        }
+        c->written++;
+    }
+
+    if (c->stills_every && slot->frame % c->stills_every == 0) {
+        // video.y4m -> video-000120.png
+        char path[1024];
+        const char *dot = strrchr(c->path, '.');
+        const int base = dot ? (int) (dot - c->path) : (int) strlen(c->path);
+        snprintf(path, sizeof(path), "%.*s-%06llu.png", base, c->path, (unsigned long long) slot->frame);
+        if (!write_png(path, rows)) {
+            perror("capture png");
+            c->failed = true;
+            return;
+        }
+        c->stills++;
+    }
+}
+
+static void* encoder(void *arg) {
+    capture *c = arg;
+    uint8_t *rows = malloc(SCREEN_BYTES);
+    uint8_t *gray = malloc(CAPTURE_WIDTH * CAPTURE_HEIGHT);
+    uint8_t *chroma = malloc(CHROMA_BYTES * 2);
+    memset(chroma, 128, CHROMA_BYTES * 2);
+    uint64_t *lut = malloc(256 * sizeof(uint64_t));
+    if (c->y4m) {
+        gray_lut(lut, 16, 235); // video range luma
+    } else {
+        gray_lut(lut, 0, 255);
+    }
+
+    for (;;) {
+        const uint64_t tail = atomic_load_explicit(&c->tail, memory_order_relaxed);
+        if (tail == atomic_load(&c->head)) {
+            pthread_mutex_lock(&c->lock);
+            atomic_store(&c->want_more, true);
+            while (tail == atomic_load(&c->head) && !atomic_load(&c->quit)) {
+                pthread_cond_wait(&c->more, &c->lock);
+            }
+            atomic_store(&c->want_more, false);
+            pthread_mutex_unlock(&c->lock);
+            if (tail == atomic_load(&c->head)) break; // quit and drained
+            continue;
+        }
+
+        if (!c->failed) {
+            encode(c, &c->queue[tail & (CAPTURE_QUEUE_SIZE - 1)], rows, gray, chroma, lut);
+        }
+        atomic_store(&c->tail, tail + 1);
+
+        if (atomic_load(&c->want_room)) {
+            pthread_mutex_lock(&c->lock);
+            pthread_cond_signal(&c->room);
+            pthread_mutex_unlock(&c->lock);
+        }
+    }
+
+    free(rows);
+    free(gray);
+    free(chroma);
+    free(lut);
+    return NULL;
+}
+
+capture* capture_open(const char *path, int stills_every, bool drop) {
+    capture *c = calloc(1, sizeof(capture));
+    c->path = path;
+    c->stills_every = stills_every;
+    c->drop = drop;
+
+    const char *ext = strrchr(path, '.');
+    c->y4m = ext && strcmp(ext, ".y4m") == 0;
+    c->video = fopen(path, "wb");
+    if (c->video == NULL) {
+        free(c);
+        return NULL;
+    }
+    if (c->y4m) {
+        fprintf(c->video, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C420jpeg\n", CAPTURE_WIDTH, CAPTURE_HEIGHT);
+    }
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->more, NULL);
+    pthread_cond_init(&c->room, NULL);
+    pthread_create(&c->thread, NULL, encoder, c);
+    return c;
+}
+
+void capture_frame(capture *c, const uint8_t *vram) {
+    const uint64_t frame = c->frames++;
+    const uint64_t head = atomic_load_explicit(&c->head, memory_order_relaxed);
+    uint64_t depth = head - atomic_load(&c->tail);
+
+    if (depth == CAPTURE_QUEUE_SIZE) {
+        if (c->drop) {
+            c->dropped++;
+            return;
+        }
+        const uint64_t start = now_ns();
+        pthread_mutex_lock(&c->lock);
+        atomic_store(&c->want_room, true);
+        while (head - atomic_load(&c->tail) == CAPTURE_QUEUE_SIZE) {
+            pthread_cond_wait(&c->room, &c->lock);
+        }
+        atomic_store(&c->want_room, false);
+        pthread_mutex_unlock(&c->lock);
+        c->stalls++;
+        c->stall_ns += now_ns() - start;
+        depth = head - atomic_load(&c->tail);
+    }
+
+    capture_slot *slot = &c->queue[head & (CAPTURE_QUEUE_SIZE - 1)];
+    slot->frame = frame;
+    memcpy(slot->vram, vram, CAPTURE_VRAM_SIZE);
+    atomic_store(&c->head, head + 1);
+    if (depth + 1 > c->max_depth) {
+        c->max_depth = depth + 1;
+    }
+
+    if (atomic_load(&c->want_more)) {
+        pthread_mutex_lock(&c->lock);
+        pthread_cond_signal(&c->more);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+void capture_close(capture *c) {
+    pthread_mutex_lock(&c->lock);
+    atomic_store(&c->quit, true);
+    pthread_cond_signal(&c->more);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    printf("capture: %s, %llu frames written, %llu stills, %llu dropped, %llu stalls (%.1f ms), max queue %llu/%d%s\n",
+        c->path, (unsigned long long) c->written, (unsigned long long) c->stills, (unsigned long long) c->dropped,
+        (unsigned long long) c->stalls, c->stall_ns / 1e6, (unsigned long long) c->max_depth, CAPTURE_QUEUE_SIZE,
+        c->failed ? ", write failed" : "");
+    fclose(c->video);
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->more);
+    pthread_cond_destroy(&c->room);
+    free(c);
+}
@@ -0,0 +1,72 @@
+#ifndef capture_h
+#define capture_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Headless video capture. The emulation thread copies each frame's VRAM
+// onto a bounded single producer/single consumer queue, a background
+// thread turns the frames into pixels and streams them to a Y4M file
+// (.y4m, 224x256 60 fps 4:2:0, chroma flat) or raw 8 bit gray frames
+// (anything else, ffmpeg -f rawvideo -pix_fmt gray -s 224x256), plus a
+// 1 bit PNG still every stills_every frames when asked.
+//
+// When the encoder falls behind and the queue is full, the emulation
+// either waits for room (lossless, the default) or drops the frame. Both
+// are counted, along with the deepest the queue got.
+
+#define CAPTURE_QUEUE_SIZE 64 // frames, must be a power of 2
+#define CAPTURE_VRAM 0x2400
+#define CAPTURE_VRAM_SIZE 0x1c00
+#define CAPTURE_WIDTH 224
+#define CAPTURE_HEIGHT 256
+
+typedef struct {
+    uint64_t frame;
+    uint8_t vram[CAPTURE_VRAM_SIZE];
+} capture_slot;
+
+typedef struct {
+    capture_slot queue[CAPTURE_QUEUE_SIZE];
+    _Atomic uint64_t head; // emulation thread
+    _Atomic uint64_t tail; // encoder
+
+    // emulation thread side
+    bool drop; // drop frames instead of waiting on a full queue
+    uint64_t frames; // handed to capture_frame()
+    uint64_t dropped;
+    uint64_t stalls; // frames that had to wait for room
+    uint64_t stall_ns;
+    uint64_t max_depth;
+
+    // the encoder sleeps on more, the emulation thread on room
+    pthread_mutex_t lock;
+    pthread_cond_t more;
+    pthread_cond_t room;
+    _Atomic bool want_more;
+    _Atomic bool want_room;
+    _Atomic bool quit;
+    pthread_t thread;
+
+    // encoder side
+    FILE *video;
+    bool y4m;
+    const char *path;
+    int stills_every; // 0 = no stills
+    uint64_t written;
+    uint64_t stills;
+    bool failed; // a write failed, the rest is thrown away
+} capture;
+
+capture* capture_open(const char *path, int stills_every, bool drop);
+
+// Emulation thread, once per completed frame
+void capture_frame(capture *c, const uint8_t *vram);
+
+// Waits for the encoder to write out what's queued, prints the stats
+void capture_close(capture *c);
+
+#endif
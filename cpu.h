@@ -4,6 +4,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 // Register Pairs:
 // B = B and C (0 and 1)
@@ -30,8 +31,16 @@ typedef struct {
     // uint8_t pad:3; // to make this struct 8bit
 } flags;
 
+struct sound;
+struct input;
+
+#define MEM_SIZE 0x10000
+#define CACHE_LINE 64
+
+// The registers, flags and cycle counter the instruction loop touches all
+// sit in the first cache line, the board state that's only touched by
+// IN/OUT and interrupts comes after it. Memory is a separate allocation.
 typedef struct {
-    uint8_t mem[0xffff]; // 35536 bytes
     flags f;
     uint8_t A; // accumulator
     
@@ -64,12 +73,97 @@ typedef struct {
     uint16_t pc;
     bool interrupts_disabled;
     bool exit;
+    uint64_t cycles; // clock states executed so far
+    uint8_t *mem; // MEM_SIZE bytes, page aligned
+    uint64_t instructions; // retired by exec()/run(), not counted by lanes or aot
+
+    // Space Invaders board, lives here so every machine gets its own
+    _Alignas(CACHE_LINE) uint8_t io_ports[8]; // TODO.. we only need 2x uints8's
+    uint8_t shift0;
+    uint8_t shift1;
+    uint8_t shift_offset;
+    bool interrupt_flag; // next interrupt is the end of frame one (RST 2)
+    struct sound *sound; // OUT 3/5 go here, NULL = silent
+    struct input *input; // IN 1/2 catch up on queued events first, NULL = none
+
+    // A -DCPU_8085 build is an Intel 8085 instead: the same opcode bodies
+    // with its clock states, RIM/SIM and the TRAP and RST 5.5/6.5/7.5 pins.
+    // None of it is compiled into 8080 builds, their hot loop is unchanged.
+#ifdef CPU_8085
+    uint8_t int_mask; // M7.5 M6.5 M5.5 in bits 2-0, set by SIM
+    uint8_t int_pending; // I7.5 I6.5 I5.5 in bits 2-0, 7.5 latched, the others follow their pins
+    bool sid; // serial input pin, RIM bit 7
+    bool sod; // serial output latch, SIM bit 7
+    uint8_t ei_delay; // EI takes effect after the instruction that follows it
+#endif
 } CPU;
 
+_Static_assert(offsetof(CPU, instructions) + sizeof(uint64_t) <= CACHE_LINE, "hot CPU state must fit one cache line");
 
+
+// NULL when the machine or its memory can't be allocated
 CPU* init(const uint16_t base_addr);
+CPU* clone_cpu(const CPU* cpu);
+// clone_cpu() into an existing machine, no allocation, the snapshot/restore
+// of run-ahead
+void copy_cpu(CPU* dst, const CPU* src);
+void free_cpu(CPU* cpu);
 void load(CPU* cpu, const uint16_t base_addr, const uint8_t *program, size_t size);
 void exec(CPU* cpu);
+
+// run() executes instructions until the cycle budget is spent, cpu->exit
+// is set or one of the requested stop conditions hits. Every condition is
+// checked after an instruction retires, so run() always makes progress and
+// resuming after a stop doesn't stop again at once.
+typedef enum {
+    RUN_BUDGET, // the cycle budget is spent
+    RUN_EXIT, // cpu->exit was set
+    RUN_PC, // pc reached stop->pc
+    RUN_OUT, // an OUT executed, the port is mem[pc - 1]
+    RUN_WRITE, // memory in [write_start, write_end] was written
+    RUN_HALT, // a HLT executed
+    RUN_INTERRUPT, // an EI executed, interrupts can be taken from here on
+} run_reason;
+
+#define RUN_STOP_PC        (1 << 0)
+#define RUN_STOP_OUT       (1 << 1)
+#define RUN_STOP_WRITE     (1 << 2)
+#define RUN_STOP_HALT      (1 << 3)
+#define RUN_STOP_INTERRUPT (1 << 4)
+
+typedef struct {
+    uint32_t on; // RUN_STOP_* bits
+    uint16_t pc;
+    uint16_t write_start; // inclusive range, e.g. VRAM 0x2400-0x3fff
+    uint16_t write_end;
+} run_stop;
+
+// stop may be NULL, then only the budget and cpu->exit end the run
+run_reason run(CPU* cpu, const uint64_t cycles, const run_stop *stop);
 void handle_interrupt(CPU* cpu, uint8_t interrupt);
 
+#ifdef CPU_8085
+// The 8085's interrupt pins, lowest priority first
+typedef enum { INT_RST55, INT_RST65, INT_RST75, INT_TRAP } int_line;
+
+// Drives a pin. TRAP and RST 7.5 fire on the raised edge, 7.5 stays latched
+// until it's taken or SIM resets it, RST 5.5/6.5 are pending for as long as
+// their level is. An unmasked pending one is taken at once if interrupts
+// are enabled, TRAP always is.
+void interrupt_8085(CPU* cpu, int_line line, bool level);
+// Takes the highest pending unmasked interrupt, if interrupts are enabled
+void interrupt_8085_poll(CPU* cpu);
+#endif
+
+// Memory the instruction at pc is about to read/write, opcode fetch excluded.
+// The one decoder of them, for run()'s write stops and the watchpoints.
+typedef struct {
+    uint16_t read;
+    int read_len;
+    uint16_t write;
+    int write_len;
+} accesses;
+
+void decode_accesses(const CPU *cpu, accesses *acc);
+
 #endif
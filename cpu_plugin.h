@@ -1,11 +1,89 @@
+#ifndef cpu_plugin_h
+#define cpu_plugin_h
+
 #include <stdbool.h>
+#include <assert.h>
 #include "cpu.h"
+#include "sound.h"
+#include "input.h"
 
 // for diag roms originally intended for CP/M OS.
 // patches jmp calls to print routines etc...
 // TODO: emu to whole CP/M OS???
-bool emu_cp_m_os;
-char emu_cp_m_os_output[1024];
+#define CP_M_OS_OUTPUT_SIZE 4096
+
+// Machine profiles. The default build hooks CALL, IN and OUT before every
+// instruction and handles the CP/M BDOS and the Space Invaders board
+// both. A profile build (-DMACHINE=..., make emu-invaders, emu-bench-cpm
+// etc.) compiles in only its machine's devices, straight into the
+// opcode bodies of cpu_ops.h, with nothing checked per instruction.
+#define MACHINE_ANY 0
+#define MACHINE_INVADERS 1 // the board on IN/OUT, CALL 5 is a plain call
+#define MACHINE_CPM 2 // CALL 5 is the BDOS, nothing on IN/OUT
+#define MACHINE_BARE 3 // the CPU alone
+
+#ifndef MACHINE
+#define MACHINE MACHINE_ANY
+#endif
+
+extern bool emu_cp_m_os;
+extern char emu_cp_m_os_output[CP_M_OS_OUTPUT_SIZE];
 
 bool cpu_plugin_op(CPU* cpu, const uint8_t op, const uint8_t hi, const uint8_t lo);
-void cpu_plugin_ret(uint16_t retaddr);
\ No newline at end of file
+
+// The only ops cpu_plugin_op() takes over: CALL (BDOS), IN and OUT
+static inline bool cpu_plugin_hooks(const uint8_t op) {
+    return op == 0xcd || op == 0xdb || op == 0xd3;
+}
+void cpu_plugin_ret(uint16_t retaddr);
+
+void cp_m_os_bdos(CPU* cpu);
+
+// CALL 5
+static inline bool cp_m_os_call(CPU* cpu, const uint8_t hi, const uint8_t lo) {
+    if (((hi << 8) | lo) != 0x0005) return false;
+    cp_m_os_bdos(cpu);
+    cpu->pc += 3;
+    return true;
+}
+
+// IN on the Space Invaders board
+static inline void board_in(CPU* cpu, const uint8_t port) {
+    uint8_t res = 0;
+    if (cpu->input) {
+        input_sync(cpu->input, cpu);
+    }
+    switch(port) {
+        case 0: res = 1; break;
+        case 1: res = cpu->io_ports[1]; break;
+        case 2: res = 0; break;
+        case 3: {
+            uint16_t v = (cpu->shift1 << 8) | cpu->shift0;
+            res = ((v >> (8 - cpu->shift_offset)) & 0xff);
+            break;
+        }
+    }
+    cpu->A = res;
+    cpu->pc += 2;
+}
+
+// OUT on the Space Invaders board
+static inline void board_out(CPU* cpu, const uint8_t port) {
+    switch(port) {
+        case 2: cpu->shift_offset = cpu->A & 0x7; break;
+        case 3: // sound related
+        case 5: {
+            if (cpu->sound && cpu->io_ports[port] != cpu->A) {
+                sound_out(cpu->sound, cpu->cycles, port, cpu->A);
+            }
+            break;
+        }
+        case 4: cpu->shift0 = cpu->shift1; cpu->shift1 = cpu->A; break;
+        case 6: break; // strange 'debug' port?
+        default: assert(0);
+    }
+    cpu->io_ports[port] = cpu->A;
+    cpu->pc += 2;
+}
+
+#endif
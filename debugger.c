@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "debugger.h"
+#include "disass.h"
+
+#define NUM_GDB_REGS 13 // z80: af bc de hl sp pc ix iy af' bc' de' hl' ir
+#define MONITOR_DISASS_LINES 10
+
+#define IS_SET(map, addr) ((map)[(addr) >> 3] & (1 << ((addr) & 7)))
+
+static void set_bits(uint8_t *map, const uint16_t addr, const int len, const bool on) {
+    for (int i = 0; i < len; i++) {
+        const uint16_t a = addr + i;
+        if (on) map[a >> 3] |= 1 << (a & 7);
+        else map[a >> 3] &= ~(1 << (a & 7));
+    }
+}
+
+static bool any_set(const uint8_t *map, const uint16_t addr, const int len) {
+    for (int i = 0; i < len; i++) {
+        if (IS_SET(map, (uint16_t) (addr + i))) return true;
+    }
+    return false;
+}
+
+static const char hexchars[] = "0123456789abcdef";
+
+static int unhex(const char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void send_packet(debugger *d, const char *data) {
+    const size_t len = strlen(data);
+    char *buf = malloc(len + 4);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++) {
+        sum += (uint8_t) data[i];
+    }
+    buf[0] = '$';
+    memcpy(buf + 1, data, len);
+    buf[len + 1] = '#';
+    buf[len + 2] = hexchars[sum >> 4];
+    buf[len + 3] = hexchars[sum & 0xf];
+    if (write(d->fd, buf, len + 4) < 0) {
+        perror("debugger write");
+    }
+    free(buf);
+}
+
+// Sends text to the client's console (gdb 'O' packet).
+static void send_console(debugger *d, const char *text) {
+    const size_t len = strlen(text);
+    char *buf = malloc(len * 2 + 2);
+    buf[0] = 'O';
+    for (size_t i = 0; i < len; i++) {
+        buf[1 + i * 2] = hexchars[(uint8_t) text[i] >> 4];
+        buf[2 + i * 2] = hexchars[(uint8_t) text[i] & 0xf];
+    }
+    buf[1 + len * 2] = '\0';
+    send_packet(d, buf);
+    free(buf);
+}
+
+// Next byte from the client, blocking. -1 when the client went away.
+static int next_char(debugger *d) {
+    if (d->in_pos == d->in_len) {
+        const ssize_t n = read(d->fd, d->in, sizeof(d->in));
+        if (n <= 0) return -1;
+        d->in_len = n;
+        d->in_pos = 0;
+    }
+    return (uint8_t) d->in[d->in_pos++];
+}
+
+static int read_packet(debugger *d, char *packet, const int size) {
+    int c;
+    do {
+        // acks and ^C while already stopped are noise here
+        if ((c = next_char(d)) < 0) return -1;
+    } while (c != '$');
+
+    int len = 0;
+    while ((c = next_char(d)) != '#') {
+        if (c < 0) return -1;
+        if (len < size - 1) packet[len++] = c;
+    }
+    packet[len] = '\0';
+
+    // we're on a reliable socket, don't bother verifying the checksum
+    if (next_char(d) < 0 || next_char(d) < 0) return -1;
+    if (write(d->fd, "+", 1) < 0) return -1;
+    return len;
+}
+
+static void detach(debugger *d) {
+    memset(d->breakpoints, 0, sizeof(d->breakpoints));
+    memset(d->watch_read, 0, sizeof(d->watch_read));
+    memset(d->watch_write, 0, sizeof(d->watch_write));
+    d->num_breakpoints = 0;
+    d->num_watchpoints = 0;
+    d->step = false;
+    d->watch_hit = false;
+    if (d->fd >= 0) {
+        close(d->fd);
+        d->fd = -1;
+    }
+    printf("debugger detached\n");
+}
+
+static void read_regs(const CPU *cpu, char *out) {
+    uint16_t regs[NUM_GDB_REGS] = { 0 };
+    regs[0] = (cpu->A << 8) | *(const uint8_t*) &cpu->f;
+    regs[1] = cpu->BC;
+    regs[2] = cpu->DE;
+    regs[3] = cpu->HL;
+    regs[4] = cpu->sp;
+    regs[5] = cpu->pc;
+    for (int i = 0; i < NUM_GDB_REGS; i++) {
+        // little endian, like the target
+        sprintf(out + i * 4, "%02x%02x", regs[i] & 0xff, regs[i] >> 8);
+    }
+}
+
+static void write_regs(CPU *cpu, const char *hex) {
+    uint16_t regs[6];
+    for (int i = 0; i < 6; i++) {
+        const char *p = hex + i * 4;
+        if (strlen(p) < 4) return;
+        regs[i] = (unhex(p[0]) << 4 | unhex(p[1])) | (unhex(p[2]) << 4 | unhex(p[3])) << 8;
+    }
+    cpu->A = regs[0] >> 8;
+    const uint8_t f = regs[0] & 0xff;
+    memcpy(&cpu->f, &f, sizeof(flags));
+    cpu->BC = regs[1];
+    cpu->DE = regs[2];
+    cpu->HL = regs[3];
+    cpu->sp = regs[4];
+    cpu->pc = regs[5];
+}
+
+static void monitor(debugger *d, CPU *cpu, const char *hex) {
+    char cmd[256];
+    size_t len = 0;
+    for (; hex[0] && hex[1] && len < sizeof(cmd) - 1; hex += 2) {
+        cmd[len++] = unhex(hex[0]) << 4 | unhex(hex[1]);
+    }
+    cmd[len] = '\0';
+
+    char line[DISASS_OP_SIZE + 2];
+    if (strncmp(cmd, "disass", 6) == 0) {
+        unsigned int addr = cpu->pc, n = MONITOR_DISASS_LINES;
+        sscanf(cmd + 6, "%x %u", &addr, &n);
+        for (unsigned int i = 0; i < n; i++) {
+            const int size = disass(line, cpu->mem, addr);
+            strcat(line, "\n");
+            send_console(d, line);
+            addr = (addr + size) & 0xffff;
+        }
+    } else if (strncmp(cmd, "regs", 4) == 0) {
+        char regs[160];
+        snprintf(regs, sizeof(regs), "PC=%04x SP=%04x A=%02x BC=%04x DE=%04x HL=%04x c:%x p:%x ac:%x z:%x s:%x cycles=%llu\n",
+            cpu->pc, cpu->sp, cpu->A, cpu->BC, cpu->DE, cpu->HL, cpu->f.carry, cpu->f.parity,
+            cpu->f.auxcarry, cpu->f.zero, cpu->f.sign, (unsigned long long) cpu->cycles);
+        send_console(d, regs);
+    } else {
+        send_console(d, "commands: disass [addr] [n], regs\n");
+    }
+    send_packet(d, "OK");
+}
+
+static void rebuild_watch(debugger *d) {
+    memset(d->watch_read, 0, sizeof(d->watch_read));
+    memset(d->watch_write, 0, sizeof(d->watch_write));
+    for (int i = 0; i < d->num_watchpoints; i++) {
+        const watchpoint *w = &d->watchpoints[i];
+        if (w->type == 2 || w->type == 4) set_bits(d->watch_write, w->addr, w->len, true);
+        if (w->type == 3 || w->type == 4) set_bits(d->watch_read, w->addr, w->len, true);
+    }
+}
+
+static void breakpoint(debugger *d, const char *args, const bool insert) {
+    unsigned int type, addr, len;
+    if (sscanf(args, "%x,%x,%x", &type, &addr, &len) != 3 || type > 4) {
+        send_packet(d, "E01");
+        return;
+    }
+
+    if (type <= 1) {
+        // software and hardware breakpoints are the same thing to us
+        const bool was = IS_SET(d->breakpoints, addr & 0xffff);
+        set_bits(d->breakpoints, addr, 1, insert);
+        d->num_breakpoints += insert ? !was : -was;
+    } else {
+        const watchpoint w = { .type = type, .addr = addr, .len = len };
+        if (insert) {
+            if (d->num_watchpoints == MAX_WATCHPOINTS) {
+                send_packet(d, "E02");
+                return;
+            }
+            d->watchpoints[d->num_watchpoints++] = w;
+        } else {
+            for (int i = 0; i < d->num_watchpoints; i++) {
+                const watchpoint *o = &d->watchpoints[i];
+                if (o->type == w.type && o->addr == w.addr && o->len == w.len) {
+                    d->watchpoints[i] = d->watchpoints[--d->num_watchpoints];
+                    break;
+                }
+            }
+        }
+        rebuild_watch(d);
+    }
+    send_packet(d, "OK");
+}
+
+// Handles one packet, returns true when the cpu should run again.
+static bool handle(debugger *d, CPU *cpu, char *p) {
+    char buf[DEBUGGER_BUF_SIZE];
+    unsigned int addr, len;
+
+    switch (p[0]) {
+        case '?': send_packet(d, "S05"); return false;
+        case 'g': read_regs(cpu, buf); send_packet(d, buf); return false;
+        case 'G': write_regs(cpu, p + 1); send_packet(d, "OK"); return false;
+        case 'm': {
+            if (sscanf(p + 1, "%x,%x", &addr, &len) != 2 || len > (sizeof(buf) - 1) / 2) {
+                send_packet(d, "E01");
+                return false;
+            }
+            for (unsigned int i = 0; i < len; i++) {
+                const uint8_t v = cpu->mem[(uint16_t) (addr + i)];
+                buf[i * 2] = hexchars[v >> 4];
+                buf[i * 2 + 1] = hexchars[v & 0xf];
+            }
+            buf[len * 2] = '\0';
+            send_packet(d, buf);
+            return false;
+        }
+        case 'M': {
+            const char *data = strchr(p, ':');
+            // bounded like 'm' before the multiplication, which would wrap
+            if (sscanf(p + 1, "%x,%x", &addr, &len) != 2 || len > (sizeof(buf) - 1) / 2 || data == NULL
+                    || strlen(data + 1) < len * 2) {
+                send_packet(d, "E01");
+                return false;
+            }
+            for (unsigned int i = 0; i < len; i++) {
+                cpu->mem[(uint16_t) (addr + i)] = unhex(data[1 + i * 2]) << 4 | unhex(data[2 + i * 2]);
+            }
+            send_packet(d, "OK");
+            return false;
+        }
+        case 'c':
+        case 's': {
+            if (sscanf(p + 1, "%x", &addr) == 1) {
+                cpu->pc = addr;
+            }
+            d->step = p[0] == 's';
+            return true;
+        }
+        case 'Z': breakpoint(d, p + 1, true); return false;
+        case 'z': breakpoint(d, p + 1, false); return false;
+        case 'H': send_packet(d, "OK"); return false;
+        case 'k': cpu->exit = true; detach(d); return true;
+        case 'D': send_packet(d, "OK"); detach(d); return true;
+        case 'q': {
+            if (strncmp(p, "qSupported", 10) == 0) {
+                snprintf(buf, sizeof(buf), "PacketSize=%x", DEBUGGER_BUF_SIZE);
+                send_packet(d, buf);
+            } else if (strcmp(p, "qAttached") == 0) {
+                send_packet(d, "1");
+            } else if (strncmp(p, "qRcmd,", 6) == 0) {
+                monitor(d, cpu, p + 6);
+            } else {
+                send_packet(d, "");
+            }
+            return false;
+        }
+        default: send_packet(d, ""); return false; // not supported
+    }
+}
+
+// Stopped: talk to the client until it resumes us.
+static void serve(debugger *d, CPU *cpu) {
+    char packet[DEBUGGER_BUF_SIZE];
+    while (d->fd >= 0) {
+        if (read_packet(d, packet, sizeof(packet)) < 0) {
+            detach(d);
+            return;
+        }
+        if (handle(d, cpu, packet)) {
+            return;
+        }
+    }
+}
+
+debugger* debugger_open(const char *path, CPU *cpu) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listen_fd, 1) != 0) {
+        perror("debugger socket");
+        if (listen_fd >= 0) close(listen_fd);
+        return NULL;
+    }
+
+    printf("waiting for debugger on %s\n", path);
+    const int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        perror("debugger accept");
+        close(listen_fd);
+        return NULL;
+    }
+
+    debugger *d = calloc(sizeof(debugger), 1);
+    d->listen_fd = listen_fd;
+    d->fd = fd;
+    d->path = strdup(path);
+    serve(d, cpu);
+    d->resume_skip = true;
+    return d;
+}
+
+void debugger_close(debugger *d) {
+    if (d->fd >= 0) {
+        close(d->fd);
+    }
+    close(d->listen_fd);
+    unlink(d->path);
+    free(d->path);
+    free(d);
+}
+
+void debugger_poll(debugger *d, CPU *cpu) {
+    if (d->fd < 0) {
+        return;
+    }
+
+    struct pollfd p = { .fd = d->fd, .events = POLLIN };
+    if (d->in_pos == d->in_len) {
+        if (poll(&p, 1, 0) <= 0) {
+            return;
+        }
+        const ssize_t n = read(d->fd, d->in, sizeof(d->in));
+        if (n <= 0) {
+            detach(d);
+            return;
+        }
+        d->in_len = n;
+        d->in_pos = 0;
+    }
+
+    // ^C or any request stops the cpu, stray acks don't
+    while (d->in_pos < d->in_len && (d->in[d->in_pos] == '+' || d->in[d->in_pos] == '-')) {
+        d->in_pos++;
+    }
+    if (d->in_pos == d->in_len) {
+        return;
+    }
+    if (d->in[d->in_pos] == 0x03) {
+        d->in_pos++;
+        send_packet(d, "S02");
+    }
+    serve(d, cpu);
+    d->resume_skip = true;
+}
+
+void debugger_check(debugger *d, CPU *cpu) {
+    char reply[32] = "";
+
+    if (d->resume_skip) {
+        // we stopped outside of a check, this instruction is the one to run
+        d->resume_skip = false;
+    } else if (d->watch_hit) {
+        const char *kind = d->watch_hit_read && d->watch_hit_write ? "awatch" : d->watch_hit_write ? "watch" : "rwatch";
+        snprintf(reply, sizeof(reply), "T05%s:%04x;", kind, d->watch_hit_addr);
+    } else if (d->step || (d->num_breakpoints > 0 && IS_SET(d->breakpoints, cpu->pc))) {
+        strcpy(reply, "S05");
+    }
+    d->watch_hit = false;
+
+    if (reply[0] != '\0') {
+        d->step = false;
+        send_packet(d, reply);
+        serve(d, cpu);
+    }
+
+    if (d->num_watchpoints > 0) {
+        // report after the access happened, like a hardware watchpoint
+        accesses acc;
+        decode_accesses(cpu, &acc);
+        d->watch_hit_read = acc.read_len && any_set(d->watch_read, acc.read, acc.read_len);
+        d->watch_hit_write = acc.write_len && any_set(d->watch_write, acc.write, acc.write_len);
+        if (d->watch_hit_read || d->watch_hit_write) {
+            d->watch_hit = true;
+            d->watch_hit_addr = d->watch_hit_write ? acc.write : acc.read;
+        }
+    }
+}
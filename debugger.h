@@ -0,0 +1,68 @@
+#ifndef debugger_h
+#define debugger_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Breakpoint/watchpoint debugger served over a local unix socket. It speaks
+// a subset of the gdb remote serial protocol: registers in gdb's z80 layout
+// (af bc de hl sp pc, the z80-only ones read as 0), memory read/write,
+// continue, single step, Z0/Z1 breakpoints and Z2/Z3/Z4 watchpoints, and
+// "monitor disass [addr] [n]" / "monitor regs" through qRcmd.
+//
+// Breakpoints live in a 64K-bit bitmap, watchpoints in a list with a
+// read and a write bitmap rebuilt from it whenever one is removed, so
+// overlapping ones don't disarm each other's bytes. main.c only goes through
+// debugger_check() while debugger_armed() is true, so with nothing set the
+// instruction loop is the same as without a debugger.
+
+#define DEBUGGER_BUF_SIZE 4096
+#define MAX_WATCHPOINTS 64
+
+typedef struct {
+    uint8_t type; // 2 write, 3 read, 4 access, as in Z2/Z3/Z4
+    uint16_t addr;
+    uint16_t len;
+} watchpoint;
+
+typedef struct {
+    int listen_fd;
+    int fd;
+    char *path;
+
+    uint8_t breakpoints[0x10000 / 8];
+    uint8_t watch_read[0x10000 / 8];
+    uint8_t watch_write[0x10000 / 8];
+    int num_breakpoints;
+    int num_watchpoints;
+    watchpoint watchpoints[MAX_WATCHPOINTS]; // what the watch bitmaps are built from
+    bool step;
+    bool resume_skip; // stopped outside debugger_check(), don't stop again at once
+
+    // watchpoint hit by the last instruction, reported before the next one
+    bool watch_hit;
+    bool watch_hit_write;
+    bool watch_hit_read;
+    uint16_t watch_hit_addr;
+
+    char in[DEBUGGER_BUF_SIZE]; // bytes received but not handled yet
+    int in_len;
+    int in_pos;
+} debugger;
+
+// Listens on path and waits for the client, the cpu starts out stopped.
+debugger* debugger_open(const char *path, CPU *cpu);
+void debugger_close(debugger *d);
+
+// Once per frame, handles a break request (^C) sent while running.
+void debugger_poll(debugger *d, CPU *cpu);
+
+// Before every instruction while armed, blocks serving the client on a hit.
+void debugger_check(debugger *d, CPU *cpu);
+
+static inline bool debugger_armed(const debugger *d) {
+    return d->num_breakpoints > 0 || d->num_watchpoints > 0 || d->step || d->watch_hit;
+}
+
+#endif
@@ -1,5 +1,39 @@
+#ifndef disass_h
+#define disass_h
+
+#include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #define DISASS_OP_SIZE 128
+#define DISASS_LINE_MAX 48 // the longest disass_line(), label and newline included
+
+// Every function reads up to 2 bytes past the instruction, mem needs them
+// even at 0xffff (MEM_SIZE + 2 bytes).
+
+// Writes the listing line for the instruction at pc, returns its size
+int disass(char *output, const uint8_t *mem, const int pc);
+
+// The same line, no NUL: hex by hand from opcodes[] instead of sprintf,
+// into out as is. Returns the chars written, *size gets the instruction's.
+int disass_line(char *out, const uint8_t *mem, const uint16_t pc, int *size);
+
+typedef enum {
+    DISASS_LINEAR, // an instruction after the other from start
+    DISASS_RECURSIVE, // what the entries reach is code, the rest DB lines
+} disass_mode;
+
+typedef struct {
+    disass_mode mode;
+    uint32_t start; // [start, end), end up to 0x10000
+    uint32_t end;
+    const uint16_t *entries; // DISASS_RECURSIVE
+    int num_entries;
+    bool labels; // "L1234:" before the target of every JMP/CALL/RST
+} disass_range_options;
+
+// Lists a whole range to out, formatted into a buffer that's written as it
+// fills. Returns the number of instructions listed.
+size_t disass_range(FILE *out, const uint8_t *mem, const disass_range_options *opt);
 
-void disass(char *output, const uint8_t *mem, const int pc);
+#endif
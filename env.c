@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "env.h"
+#include "interrupts.h"
+
+// Space Invaders RAM, see computerarcheology.com's annotated disassembly
+#define RAM_GAME_MODE 0x20ef
+#define RAM_P1_SCORE 0x20f8 // LSB, MSB, BCD
+#define RAM_P1_SHIPS 0x21ff
+
+static uint32_t bcd(const uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0f);
+}
+
+static void read_info(const CPU *cpu, env_info *info) {
+    info->score = bcd(cpu->mem[RAM_P1_SCORE + 1]) * 100 + bcd(cpu->mem[RAM_P1_SCORE]);
+    info->lives = cpu->mem[RAM_P1_SHIPS];
+    info->playing = cpu->mem[RAM_GAME_MODE] != 0;
+}
+
+static void step_machine(env *e, const int i) {
+    CPU *cpu = e->machines[i];
+    env_info *info = &e->infos[i];
+    const uint32_t score = info->score;
+    const bool playing = info->playing;
+
+    cpu->io_ports[1] = e->actions[i];
+    for (int frame = 0; frame < e->frames && !cpu->exit; frame++) {
+        for (int half = 0; half < 2 && !cpu->exit; half++) {
+            interrupt(cpu, 60);
+            run(cpu, CYCLES_PER_FRAME / 2, NULL);
+        }
+    }
+
+    read_info(cpu, info);
+    info->reward = info->score - score;
+    info->done = cpu->exit || (playing && !info->playing);
+}
+
+static void step_slice(env *e, const int slice) {
+    const int from = (int64_t) e->n * slice / e->threads;
+    const int to = (int64_t) e->n * (slice + 1) / e->threads;
+    for (int i = from; i < to; i++) {
+        step_machine(e, i);
+    }
+}
+
+static void* worker(void *arg) {
+    const env_worker *w = arg;
+    env *e = w->e;
+    for (;;) {
+        pthread_barrier_wait(&e->start);
+        if (e->quit) break;
+        step_slice(e, w->slice);
+        pthread_barrier_wait(&e->done);
+    }
+    return NULL;
+}
+
+// Creates the shared array as an unlinked temp file, like rom.c's sets
+static int create_array(size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/envXXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("env mkstemp");
+        return -1;
+    }
+    unlink(path);
+    if (ftruncate(fd, size) != 0) {
+        perror("env ftruncate");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Whatever env_open() got to allocate, the workers already stopped
+static void env_free(env *e) {
+    if (e->machines) {
+        for (int i = 0; i < e->n; i++) {
+            if (e->machines[i]) free_cpu(e->machines[i]);
+        }
+    }
+    if (e->boot) {
+        free_cpu(e->boot);
+    }
+    munmap(e->ram, (size_t) e->n * ENV_RAM_SIZE);
+    if (e->own_fd) {
+        close(e->fd);
+    }
+    free(e->machines);
+    free(e->infos);
+    free(e);
+}
+
+env* env_open(const rom_image *rom, int n, int fd, off_t offset, int threads) {
+    if (n < 1 || threads < 1 || threads > ENV_MAX_THREADS || rom->base_addr + rom->size > ENV_RAM_START) {
+        return NULL;
+    }
+    if (threads > n) {
+        threads = n;
+    }
+
+    const size_t size = (size_t) n * ENV_RAM_SIZE;
+    const bool own_fd = fd < 0;
+    if (own_fd) {
+        fd = create_array(size);
+        offset = 0;
+        if (fd < 0) return NULL;
+    }
+
+    uint8_t *ram = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset);
+    if (ram == MAP_FAILED) {
+        perror("env mmap");
+        if (own_fd) close(fd);
+        return NULL;
+    }
+
+    env *e = calloc(1, sizeof(env));
+    if (e == NULL) {
+        munmap(ram, size);
+        if (own_fd) close(fd);
+        return NULL;
+    }
+    e->n = n;
+    e->rom = rom;
+    e->ram = ram;
+    e->fd = fd;
+    e->own_fd = own_fd;
+    e->threads = threads;
+    e->infos = calloc(n, sizeof(env_info));
+    e->machines = calloc(n, sizeof(CPU*));
+    e->boot = init(rom->base_addr);
+    if (e->infos == NULL || e->machines == NULL || e->boot == NULL) {
+        env_free(e);
+        return NULL;
+    }
+
+    rom_load(e->boot, rom);
+    for (int i = 0; i < n; i++) {
+        CPU *cpu = init(rom->base_addr);
+        if (cpu == NULL) {
+            env_free(e);
+            return NULL;
+        }
+        rom_load(cpu, rom);
+        // the machine's own RAM pages are replaced by its slot of the array
+        if (mmap(&cpu->mem[ENV_RAM_START], ENV_RAM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                fd, offset + (off_t) i * ENV_RAM_SIZE) == MAP_FAILED) {
+            perror("env mmap slot");
+            free_cpu(cpu);
+            env_free(e);
+            return NULL;
+        }
+        e->machines[i] = cpu;
+    }
+    env_reset(e, -1);
+
+    if (threads > 1) {
+        pthread_barrier_init(&e->start, NULL, threads);
+        pthread_barrier_init(&e->done, NULL, threads);
+        for (int t = 1; t < threads; t++) {
+            e->workers[t] = (env_worker) { e, t, 0 };
+            pthread_create(&e->workers[t].thread, NULL, worker, &e->workers[t]);
+        }
+    }
+    return e;
+}
+
+void env_close(env *e) {
+    if (e->threads > 1) {
+        e->quit = true;
+        pthread_barrier_wait(&e->start);
+        for (int t = 1; t < e->threads; t++) {
+            pthread_join(e->workers[t].thread, NULL);
+        }
+        pthread_barrier_destroy(&e->start);
+        pthread_barrier_destroy(&e->done);
+    }
+    env_free(e);
+}
+
+void env_reset(env *e, int i) {
+    if (i < 0) {
+        for (int j = 0; j < e->n; j++) {
+            env_reset(e, j);
+        }
+        return;
+    }
+
+    CPU *cpu = e->machines[i];
+    uint8_t *mem = cpu->mem;
+    *cpu = *e->boot;
+    cpu->mem = mem;
+
+    const size_t rom_end = e->rom->base_addr + e->rom->size;
+    memset(mem, 0, e->rom->base_addr);
+    memset(&mem[rom_end], 0, MEM_SIZE - rom_end);
+    if (memcmp(&mem[e->rom->base_addr], e->rom->data, e->rom->size) != 0) {
+        rom_load(cpu, e->rom); // the game wrote to its rom, get the shared pages back
+    }
+
+    env_info *info = &e->infos[i];
+    read_info(cpu, info);
+    info->reward = 0;
+    info->done = false;
+}
+
+void env_step(env *e, const uint8_t *actions, int frames) {
+    e->actions = actions;
+    e->frames = frames;
+    if (e->threads > 1) {
+        pthread_barrier_wait(&e->start);
+    }
+    step_slice(e, 0);
+    if (e->threads > 1) {
+        pthread_barrier_wait(&e->done);
+    }
+}
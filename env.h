@@ -0,0 +1,86 @@
+#ifndef env_h
+#define env_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include "cpu.h"
+#include "rom.h"
+
+// Batched environment for training and automation code: n headless Space
+// Invaders machines with reset()/step(actions) semantics, stepped by a
+// pool of threads. Each machine's RAM at 0x2000-0x3fff (work RAM, then the
+// 1bpp VRAM at 0x2400) is mapped from one shared array, one ENV_RAM_SIZE
+// slot per machine, so observations land in the caller's memory while the
+// game draws, nothing gets copied. The array is a file descriptor the
+// caller owns (shm_open, memfd, a file) or an unlinked temp file.
+
+#define ENV_RAM_START 0x2000
+#define ENV_RAM_SIZE 0x2000 // per machine slot, a page multiple
+#define ENV_VRAM_OFFSET 0x0400 // VRAM 0x2400 within a slot
+#define ENV_VRAM_SIZE 0x1c00 // 224x256 1bpp, columns bottom to top
+#define ENV_MAX_THREADS 64
+
+// Actions are port 1 bits, any combination
+#define ENV_COIN  0x01
+#define ENV_START 0x04
+#define ENV_FIRE  0x10
+#define ENV_LEFT  0x20
+#define ENV_RIGHT 0x40
+
+typedef struct {
+    uint32_t score; // player 1, the BCD at 0x20f8
+    int32_t reward; // score change during the last step
+    uint8_t lives; // ships left, 0x21ff
+    bool playing; // gameMode 0x20ef, false in attract mode
+    bool done; // the game ended or the machine exited during the last step
+} env_info;
+
+struct env;
+
+typedef struct {
+    struct env *e;
+    int slice;
+    pthread_t thread;
+} env_worker;
+
+typedef struct env {
+    int n;
+    CPU **machines;
+    CPU *boot; // state right after rom_load(), what reset goes back to
+    const rom_image *rom;
+    env_info *infos;
+
+    uint8_t *ram; // the shared array, n slots
+    int fd;
+    bool own_fd;
+
+    // the calling thread steps the first slice, workers the others
+    int threads;
+    env_worker workers[ENV_MAX_THREADS];
+    pthread_barrier_t start;
+    pthread_barrier_t done;
+    const uint8_t *actions;
+    int frames;
+    bool quit;
+} env;
+
+// fd < 0 creates the array, otherwise n * ENV_RAM_SIZE bytes of fd from
+// offset (page aligned) are used. The rom must end below ENV_RAM_START and
+// stay open while the env is. NULL when any of it can't be set up, with
+// nothing left allocated.
+env* env_open(const rom_image *rom, int n, int fd, off_t offset, int threads);
+void env_close(env *e);
+
+// Machine i from power on, -1 for all of them
+void env_reset(env *e, int i);
+
+// Every machine runs frames frames with actions[i] held on port 1
+void env_step(env *e, const uint8_t *actions, int frames);
+
+static inline uint8_t* env_obs(const env *e, int i) {
+    return e->ram + (size_t) i * ENV_RAM_SIZE + ENV_VRAM_OFFSET;
+}
+
+#endif
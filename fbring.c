@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "fbring.h"
+
+fbring* fbring_create(const char *name) {
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror("fbring shm_open");
+        return NULL;
+    }
+    if (ftruncate(fd, sizeof(fbring)) != 0) {
+        perror("fbring ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    fbring *r = mmap(NULL, sizeof(fbring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        perror("fbring mmap");
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // fresh pages are zero, every slot starts out even and empty
+    r->slots = FBRING_SLOTS;
+    r->frame_size = FBRING_FRAME_SIZE;
+    atomic_thread_fence(memory_order_release);
+    r->magic = FBRING_MAGIC;
+    return r;
+}
+
+void fbring_publish(fbring *r, const uint8_t *vram, const uint64_t cycles) {
+    const uint64_t frame = atomic_load_explicit(&r->frames, memory_order_relaxed);
+    fbring_slot *s = &r->slot[frame % FBRING_SLOTS];
+    const uint64_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s->frame = frame;
+    s->cycles = cycles;
+    memcpy(s->vram, vram, FBRING_FRAME_SIZE);
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+
+    atomic_store_explicit(&r->frames, frame + 1, memory_order_release);
+}
+
+void fbring_destroy(fbring *r, const char *name) {
+    munmap(r, sizeof(fbring));
+    shm_unlink(name);
+}
+
+const fbring* fbring_attach(const char *name) {
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    const fbring *r = mmap(NULL, sizeof(fbring), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        return NULL;
+    }
+    if (r->magic != FBRING_MAGIC || r->slots != FBRING_SLOTS || r->frame_size != FBRING_FRAME_SIZE) {
+        munmap((void*) r, sizeof(fbring));
+        return NULL;
+    }
+    return r;
+}
+
+void fbring_detach(const fbring *r) {
+    munmap((void*) r, sizeof(fbring));
+}
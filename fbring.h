@@ -0,0 +1,67 @@
+#ifndef fbring_h
+#define fbring_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "cpu.h"
+
+// Frame export to other local processes: the emulator publishes every
+// completed frame, the raw 1bpp VRAM from 0x2400 with its frame number,
+// into a ring of slots in POSIX shared memory. Each slot is versioned like
+// a seqlock, odd while the producer writes it, so any number of consumers
+// read frames in place and just retry when the producer lapped them. The
+// producer never waits on anyone.
+//
+// A consumer reads the newest frame like this:
+//
+//   const uint64_t n = fbring_frames(r);
+//   const fbring_slot *s = &r->slot[(n - 1) % FBRING_SLOTS];
+//   const uint64_t seq = fbring_begin(s);
+//   ... use s->vram, s->frame ...
+//   if (!fbring_end(s, seq)) retry;
+
+#define FBRING_MAGIC 0x38303830 // "8080"
+#define FBRING_SLOTS 8
+#define FBRING_VRAM 0x2400
+#define FBRING_FRAME_SIZE 0x1c00 // 224x256 1bpp, columns bottom to top
+
+typedef struct {
+    _Alignas(CACHE_LINE) _Atomic uint64_t seq; // odd while being written
+    uint64_t frame; // 0 based, frames published before this one
+    uint64_t cycles; // emulated cycles when the frame completed
+    uint8_t vram[FBRING_FRAME_SIZE];
+} fbring_slot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slots;
+    uint32_t frame_size;
+    _Atomic uint64_t frames; // published so far
+    fbring_slot slot[FBRING_SLOTS];
+} fbring;
+
+// Producer, name is a shm_open() name like "/invaders-fb"
+fbring* fbring_create(const char *name);
+void fbring_publish(fbring *r, const uint8_t *vram, const uint64_t cycles);
+void fbring_destroy(fbring *r, const char *name);
+
+// Consumers, read only
+const fbring* fbring_attach(const char *name);
+void fbring_detach(const fbring *r);
+
+static inline uint64_t fbring_frames(const fbring *r) {
+    return atomic_load_explicit(&r->frames, memory_order_acquire);
+}
+
+static inline uint64_t fbring_begin(const fbring_slot *s) {
+    return atomic_load_explicit(&s->seq, memory_order_acquire);
+}
+
+// True when the slot didn't change since fbring_begin(), what was read is good
+static inline bool fbring_end(const fbring_slot *s, const uint64_t seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return !(seq & 1) && atomic_load_explicit(&s->seq, memory_order_relaxed) == seq;
+}
+
+#endif
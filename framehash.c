@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "framehash.h"
+
+#define M 0xc6a4a7935bd1e995ULL
+
+static inline uint64_t mix(uint64_t k) {
+    k *= M;
+    k ^= k >> 47;
+    return k * M;
+}
+
+// MurmurHash64A's mixing over 4 independent lanes, so the multiplies
+// overlap instead of waiting on each other
+uint64_t framehash_bytes(const uint64_t seed, const uint8_t *p, const size_t size) {
+    uint64_t h[4] = { seed, seed + 1, seed + 2, seed + 3 };
+    for (size_t i = 0; i < size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t k;
+            memcpy(&k, &p[i + lane * 8], 8);
+            h[lane] = (h[lane] ^ mix(k)) * M;
+        }
+    }
+
+    uint64_t res = size * M;
+    for (int lane = 0; lane < 4; lane++) {
+        res = (res ^ mix(h[lane])) * M;
+    }
+    res ^= res >> 47;
+    res *= M;
+    return res ^ (res >> 47);
+}
+
+uint64_t framehash(const uint8_t *vram) {
+    return framehash_bytes(FRAMEHASH_VRAM, vram, FRAMEHASH_VRAM_SIZE);
+}
+
+framehash_log* framehash_create(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL || fwrite(FRAMEHASH_MAGIC, 4, 1, f) != 1) {
+        if (f) fclose(f);
+        return NULL;
+    }
+    framehash_log *log = calloc(1, sizeof(framehash_log));
+    log->f = f;
+    return log;
+}
+
+void framehash_append(framehash_log *log, const uint8_t *vram) {
+    const uint64_t h = framehash(vram);
+    uint8_t le[8];
+    for (int i = 0; i < 8; i++) {
+        le[i] = h >> (i * 8);
+    }
+    fwrite(le, sizeof(le), 1, log->f);
+    log->frames++;
+}
+
+void framehash_close(framehash_log *log) {
+    fclose(log->f);
+    free(log);
+}
+
+uint64_t* framehash_load(const char *path, uint64_t *frames) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+
+    char magic[4];
+    if (fread(magic, 4, 1, f) != 1 || memcmp(magic, FRAMEHASH_MAGIC, 4) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    size_t cap = 4096, n = 0;
+    uint64_t *hashes = malloc(cap * sizeof(uint64_t));
+    uint8_t le[8];
+    while (fread(le, sizeof(le), 1, f) == 1) {
+        if (n == cap) {
+            cap *= 2;
+            hashes = realloc(hashes, cap * sizeof(uint64_t));
+        }
+        uint64_t h = 0;
+        for (int i = 0; i < 8; i++) {
+            h |= (uint64_t) le[i] << (i * 8);
+        }
+        hashes[n++] = h;
+    }
+    fclose(f);
+    *frames = n;
+    return hashes;
+}
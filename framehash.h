@@ -0,0 +1,36 @@
+#ifndef framehash_h
+#define framehash_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Frame fingerprints for regression runs: a 64 bit non-cryptographic hash
+// of VRAM (0x2400-0x3fff) every frame, appended to a compact log, 8 bytes
+// per frame after a small header. emu-framecmp checks a run's log against
+// a golden one and reports the first frame that differs.
+//
+// There's no dirty tracking in the core to hash incrementally from, a
+// whole frame is 7K and hashes in about 2 microseconds at -O2 anyway.
+
+#define FRAMEHASH_VRAM 0x2400
+#define FRAMEHASH_VRAM_SIZE 0x1c00
+#define FRAMEHASH_MAGIC "VRH1"
+
+uint64_t framehash(const uint8_t *vram);
+// The same hash over any size that's a multiple of 32 bytes
+uint64_t framehash_bytes(uint64_t seed, const uint8_t *p, size_t size);
+
+typedef struct {
+    FILE *f;
+    uint64_t frames;
+} framehash_log;
+
+framehash_log* framehash_create(const char *path);
+void framehash_append(framehash_log *log, const uint8_t *vram);
+void framehash_close(framehash_log *log);
+
+// The hashes of a whole log, malloc'ed, NULL when it isn't one
+uint64_t* framehash_load(const char *path, uint64_t *frames);
+
+#endif
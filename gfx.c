@@ -1,51 +1,48 @@
 #include <SDL2/SDL.h>
 #include "gfx.h"
+#include "screen.h"
 
-#define SCREEN_WIDTH 224
-#define SCREEN_HEIGHT 256
-#define SCREEN_PIXELS SCREEN_HEIGHT * SCREEN_WIDTH
+#define WINDOW_WIDTH 800
+#define WINDOW_HEIGHT 600
 
 SDL_Window* window;
 SDL_Surface *window_surface;
 SDL_Renderer* renderer;
 SDL_Texture* texture;
 
-#define SDL_BYTES_PER_PIXEL 4 // ARGB8888, todo: can be 3 if using mode RGB24?
-int pixels[SCREEN_WIDTH * SCREEN_HEIGHT * SDL_BYTES_PER_PIXEL];
+// the largest whole scale that fits the window, overlay and scaling are
+// done by screen_render(), SDL only copies the pixels 1:1
+screen *scr;
+uint32_t *pixels;
+SDL_Rect dest;
 
 void init_sdl(char *title) {
     SDL_Init(SDL_INIT_VIDEO);
-	window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 800, 600, SDL_WINDOW_OPENGL);
+	window = SDL_CreateWindow(title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_OPENGL);
 	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    int scale = WINDOW_WIDTH / SCREEN_WIDTH < WINDOW_HEIGHT / SCREEN_HEIGHT ? WINDOW_WIDTH / SCREEN_WIDTH : WINDOW_HEIGHT / SCREEN_HEIGHT;
+    if (scale < 1) scale = 1;
+    scr = screen_open(scale, true);
+    pixels = malloc(SCREEN_WIDTH * scale * SCREEN_HEIGHT * scale * sizeof(uint32_t));
+    dest = (SDL_Rect) {
+        (WINDOW_WIDTH - SCREEN_WIDTH * scale) / 2, (WINDOW_HEIGHT - SCREEN_HEIGHT * scale) / 2,
+        SCREEN_WIDTH * scale, SCREEN_HEIGHT * scale
+    };
+
+	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, dest.w, dest.h);
     window_surface = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, 0, 0, 0, 0);
 }
 
 void render_sdl(uint8_t *buffer) {
-    // TODO: is it faster to just stack alloc pixels on the stack here?
-    memset(pixels, 0, SCREEN_PIXELS * SDL_BYTES_PER_PIXEL);
-
-    int vram_index = 0;
-   for(int columns = 0; columns < SCREEN_WIDTH; columns++){
-        for(int row = SCREEN_HEIGHT; row > 0; row -=8){
-            for(int j = 0; j < 8; j++){
-                
-                int idx = (row - j) * SCREEN_WIDTH + columns;
-                int res = buffer[vram_index] & 1 << j; // TODO unsure
-                
-                if(res){
-                    pixels[idx] = 0xFFFFFF;             
-                } else {
-                    pixels[idx] = 0x000000;
-                }
-            }
-            vram_index++;
-        }
-    }
-
-    SDL_UpdateTexture(texture, NULL, pixels, SCREEN_WIDTH * sizeof(Uint32));
+    screen_render(scr, buffer, pixels);
+
+    SDL_UpdateTexture(texture, NULL, pixels, dest.w * sizeof(Uint32));
+}
+
+void present_sdl() {
     SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, texture, NULL, NULL);
+    SDL_RenderCopy(renderer, texture, NULL, &dest);
     SDL_RenderPresent(renderer);
     SDL_UpdateWindowSurface(window);
 }
@@ -55,4 +52,6 @@ void destroy_sdl() {
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
+    screen_close(scr);
+    free(pixels);
 }
@@ -1,5 +1,6 @@
 #include <stdint.h>
 
 void init_sdl(char *title);
-void render_sdl(uint8_t *buffer);
+void render_sdl(uint8_t *buffer); // into the texture
+void present_sdl();
 void destroy_sdl();
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "input.h"
+
+static void set_next(input *in) {
+    in->next_cycle = in->next < in->count ? in->events[in->next].cycle : UINT64_MAX;
+}
+
+static void event_apply(const input_event *e, CPU *cpu) {
+    if (e->down) {
+        cpu->io_ports[e->port] |= e->bits;
+    } else {
+        cpu->io_ports[e->port] &= ~e->bits;
+    }
+}
+
+input* input_open(const char *record_path) {
+    input *in = calloc(1, sizeof(input));
+    in->next_cycle = UINT64_MAX;
+    if (record_path) {
+        in->record = fopen(record_path, "wb");
+        if (in->record == NULL || fwrite(INPUT_MAGIC, 8, 1, in->record) != 1) {
+            if (in->record) fclose(in->record);
+            free(in);
+            return NULL;
+        }
+    }
+    return in;
+}
+
+input* input_replay(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    char magic[8];
+    if (fread(magic, 8, 1, f) != 1 || memcmp(magic, INPUT_MAGIC, 8) != 0) {
+        fclose(f);
+        return NULL;
+    }
+
+    input *in = input_open(NULL);
+    input_event e;
+    while (fread(&e, sizeof(e), 1, f) == 1) {
+        input_push(in, e.cycle, e.port, e.bits, e.down);
+    }
+    fclose(f);
+    in->replaying = true;
+    return in;
+}
+
+void input_close(input *in) {
+    if (in->record) {
+        fclose(in->record);
+    }
+    free(in->events);
+    free(in);
+}
+
+void input_push(input *in, uint64_t cycle, uint8_t port, uint8_t bits, bool down) {
+    if (in->replaying) return;
+
+    // all applied, start over instead of growing
+    if (in->next == in->count) {
+        in->next = in->count = 0;
+    }
+    if (in->count == in->cap) {
+        in->cap = in->cap ? in->cap * 2 : 64;
+        in->events = realloc(in->events, in->cap * sizeof(input_event));
+    }
+    if (in->count && cycle < in->events[in->count - 1].cycle) {
+        cycle = in->events[in->count - 1].cycle;
+    }
+
+    input_event *e = &in->events[in->count++];
+    *e = (input_event) { .cycle = cycle, .port = port, .bits = bits, .down = down };
+    if (in->record) {
+        fwrite(e, sizeof(input_event), 1, in->record);
+    }
+    set_next(in);
+}
+
+void input_apply(input *in, CPU *cpu) {
+    while (in->next < in->count && in->events[in->next].cycle <= cpu->cycles) {
+        event_apply(&in->events[in->next++], cpu);
+        in->applied++;
+    }
+    set_next(in);
+}
+
+void input_seek(input *in, uint64_t applied) {
+    in->next = applied < in->count ? applied : in->count;
+    in->applied = in->next;
+    set_next(in);
+}
+
+void input_ahead(const input *in, CPU *cpu) {
+    for (size_t i = in->next; i < in->count; i++) {
+        event_apply(&in->events[i], cpu);
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef input_h
+#define input_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "cpu.h"
+
+// Timestamped input. The frontend turns host key events into port bit
+// changes at an emulated cycle and queues them, IN 1/2 catch the ports up
+// to the current cycle before reading. A press and release within one
+// frame both reach the game, and input isn't rounded to frame boundaries.
+//
+// Every queued event can be recorded, a recording queued back in replays
+// the session exactly: same events, same cycles, same IN results.
+
+#define INPUT_MAGIC "8080INP1"
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t port; // 1 or 2
+    uint8_t bits;
+    bool down; // set the bits, or clear them
+    uint8_t pad[5];
+} input_event;
+
+typedef struct input {
+    input_event *events; // in cycle order
+    size_t count, cap;
+    size_t next; // first event not applied yet
+    uint64_t next_cycle; // its cycle, UINT64_MAX when there is none
+    FILE *record;
+    bool replaying; // input_push() is ignored, events come from the recording
+    uint64_t applied;
+} input;
+
+input* input_open(const char *record_path);
+// All of a recording, queued
+input* input_replay(const char *path);
+void input_close(input *in);
+
+// Cycles before the last queued event are moved up to it, events stay in
+// order. Ignored when replaying.
+void input_push(input *in, uint64_t cycle, uint8_t port, uint8_t bits, bool down);
+
+void input_apply(input *in, CPU *cpu);
+
+// A replay picked up after its first n events were applied, e.g. from a
+// keyframe's input_applied
+void input_seek(input *in, uint64_t applied);
+
+// IN 1/2, applies the events that are due
+static inline void input_sync(input *in, CPU *cpu) {
+    if (cpu->cycles >= in->next_cycle) {
+        input_apply(in, cpu);
+    }
+}
+
+// Every queued event applied to cpu's ports without taking them off the
+// queue, the input held through run-ahead
+void input_ahead(const input *in, CPU *cpu);
+
+#endif
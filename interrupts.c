@@ -28,8 +28,6 @@ void inject_interrupt(CPU* cpu, uint8_t interrupt) {
     cpu->pc = interrupt;
 }
 
-bool interrupt_flag;
-
 void interrupt(CPU* cpu, double fps) {
     if (cpu->interrupts_disabled) {
         // printf("interrups disabled\n");
@@ -42,7 +40,7 @@ void interrupt(CPU* cpu, double fps) {
     // TODO: DO WE NEED AN INTERRUPT QUEUE?????
 
     
-    if (!interrupt_flag) {
+    if (!cpu->interrupt_flag) {
         // RST 1
         // printf("MID FRAME INTERRUPT %zu\n", num_active_interrupts);
         inject_interrupt(cpu, 0x08);
@@ -52,7 +50,7 @@ void interrupt(CPU* cpu, double fps) {
         inject_interrupt(cpu, 0x10);
     }
 
-    interrupt_flag = !interrupt_flag;
+    cpu->interrupt_flag = !cpu->interrupt_flag;
 }
 
 void check_if_ret_from_interrupt(uint16_t retaddr) {
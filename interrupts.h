@@ -1,5 +1,9 @@
 #include "cpu.h"
 
+// The board's 1.9968 MHz clock, one RST 1 mid-screen and one RST 2 at
+// vblank per 60 Hz frame
+#define CYCLES_PER_FRAME (1996800 / 60)
+
 extern size_t num_active_interrupts;
 extern uint16_t interrupt_rets[10];
 
@@ -1,4 +1,6 @@
+#include <SDL2/SDL.h>
 #include "io.h"
+#include "interrupts.h"
 
 /* 
 Ports:    
@@ -50,14 +52,15 @@ Ports:
 
 #define TILT        BIT_2
 
-uint8_t io_ports[8]; // TODO.. we only need 2x uints8's
-#define PORT1 io_ports[1]
-#define PORT2 io_ports[2]
+// Key events since the last poll are spread over the frame about to run,
+// at the offsets they had in the host's time since then, and applied by
+// IN at those cycles
+static uint32_t last_poll;
 
 SDL_Event event;
-bool handle_user_input(CPU *cpu) {
-
-    // printf("port 1 = 0x%02x\n", PORT1);
+bool handle_user_input(CPU *cpu, input *in) {
+    const uint32_t now = SDL_GetTicks();
+    const uint32_t window = now != last_poll ? now - last_poll : 1;
 
     bool user_exit = false;
     while (SDL_PollEvent(&event)) {
@@ -65,32 +68,40 @@ bool handle_user_input(CPU *cpu) {
             user_exit = true;
         }
 
+        uint64_t cycle = cpu->cycles;
+        if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+            int32_t offset = event.key.timestamp - last_poll;
+            if (offset < 0) offset = 0;
+            if ((uint32_t) offset > window) offset = window;
+            cycle += (uint64_t) offset * (CYCLES_PER_FRAME - 1) / window;
+        }
+
         switch (event.type) {
             case SDL_KEYDOWN: {
                 switch (event.key.keysym.sym) {
                     case SDLK_q:
                     case SDLK_ESCAPE: user_exit = true; break;
-                    case SDLK_c: PORT1 |= COIN; break;
-                    case SDLK_KP_ENTER: printf("START GAME\n"); PORT1 |= P1_START; break;
-                    case SDLK_SPACE: PORT1 |= P1_SHOOT; break;
-                    case SDLK_LEFT: PORT1 |= P1_LEFT; break;
-                    case SDLK_RIGHT: PORT1 |= P1_RIGHT; break;
-                    case SDLK_UP: PORT2 |= TILT; break;
+                    case SDLK_c: input_push(in, cycle, 1, COIN, true); break;
+                    case SDLK_KP_ENTER: printf("START GAME\n"); input_push(in, cycle, 1, P1_START, true); break;
+                    case SDLK_SPACE: input_push(in, cycle, 1, P1_SHOOT, true); break;
+                    case SDLK_LEFT: input_push(in, cycle, 1, P1_LEFT, true); break;
+                    case SDLK_RIGHT: input_push(in, cycle, 1, P1_RIGHT, true); break;
+                    case SDLK_UP: input_push(in, cycle, 2, TILT, true); break;
                 }
             } break;
             case SDL_KEYUP: {
                 switch (event.key.keysym.sym) {
-                    case SDLK_c: PORT1 ^= COIN; break;
-                    case SDLK_KP_ENTER: PORT1 ^= P1_START; break;
-                    case SDLK_SPACE: PORT1 ^= P1_SHOOT; break;
-                    case SDLK_LEFT: PORT1 ^= P1_LEFT; break;
-                    case SDLK_RIGHT: PORT1 ^= P1_RIGHT; break;
-                    case SDLK_UP: PORT2 ^= TILT; break;
+                    case SDLK_c: input_push(in, cycle, 1, COIN, false); break;
+                    case SDLK_KP_ENTER: input_push(in, cycle, 1, P1_START, false); break;
+                    case SDLK_SPACE: input_push(in, cycle, 1, P1_SHOOT, false); break;
+                    case SDLK_LEFT: input_push(in, cycle, 1, P1_LEFT, false); break;
+                    case SDLK_RIGHT: input_push(in, cycle, 1, P1_RIGHT, false); break;
+                    case SDLK_UP: input_push(in, cycle, 2, TILT, false); break;
                 }
             } break;
             case SDL_QUIT: user_exit = true; break;
         }
     }
+    last_poll = now;
     return user_exit;
 }
-
@@ -1,8 +1,6 @@
 #include <stdint.h>
 #include <stdbool.h>
-#include <SDL2/SDL.h>
 #include "cpu.h"
+#include "input.h"
 
-extern uint8_t io_ports[8];
-
-bool handle_user_input(CPU *cpu);
\ No newline at end of file
+bool handle_user_input(CPU *cpu, input *in);
\ No newline at end of file
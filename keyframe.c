@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "keyframe.h"
+#include "interrupts.h"
+#include "framehash.h"
+
+static void save_regs(keyframe_regs *r, const CPU *cpu) {
+    memset(r, 0, sizeof(*r));
+    r->cycles = cpu->cycles;
+    r->instructions = cpu->instructions;
+    r->BC = cpu->BC;
+    r->DE = cpu->DE;
+    r->HL = cpu->HL;
+    r->sp = cpu->sp;
+    r->pc = cpu->pc;
+    r->A = cpu->A;
+    r->f = *(const uint8_t*) &cpu->f;
+    memcpy(r->io_ports, cpu->io_ports, sizeof(r->io_ports));
+    r->shift0 = cpu->shift0;
+    r->shift1 = cpu->shift1;
+    r->shift_offset = cpu->shift_offset;
+    r->interrupt_flag = cpu->interrupt_flag;
+    r->interrupts_disabled = cpu->interrupts_disabled;
+    r->exit = cpu->exit;
+#ifdef CPU_8085
+    r->int_mask = cpu->int_mask;
+    r->int_pending = cpu->int_pending;
+    r->sid = cpu->sid;
+    r->sod = cpu->sod;
+    r->ei_delay = cpu->ei_delay;
+#endif
+}
+
+uint64_t state_hash(const CPU *cpu) {
+    keyframe_regs r;
+    save_regs(&r, cpu);
+    r.instructions = 0;
+    _Static_assert(sizeof(r) % 32 == 16, "padded to the hash's 32 bytes below");
+    uint8_t regs[sizeof(r) + 16] = { 0 };
+    memcpy(regs, &r, sizeof(r));
+    return framehash_bytes(framehash_bytes(0x8080, regs, sizeof(regs)), cpu->mem, MEM_SIZE);
+}
+
+void keyframe_save(keyframe *k, const CPU *cpu) {
+    save_regs(&k->regs, cpu);
+    memcpy(k->mem, cpu->mem, MEM_SIZE);
+}
+
+void keyframe_restore(CPU *cpu, const keyframe *k) {
+    const keyframe_regs *r = &k->regs;
+    cpu->cycles = r->cycles;
+    cpu->instructions = r->instructions;
+    cpu->BC = r->BC;
+    cpu->DE = r->DE;
+    cpu->HL = r->HL;
+    cpu->sp = r->sp;
+    cpu->pc = r->pc;
+    cpu->A = r->A;
+    *(uint8_t*) &cpu->f = r->f;
+    memcpy(cpu->io_ports, r->io_ports, sizeof(cpu->io_ports));
+    cpu->shift0 = r->shift0;
+    cpu->shift1 = r->shift1;
+    cpu->shift_offset = r->shift_offset;
+    cpu->interrupt_flag = r->interrupt_flag;
+    cpu->interrupts_disabled = r->interrupts_disabled;
+    cpu->exit = r->exit;
+#ifdef CPU_8085
+    cpu->int_mask = r->int_mask;
+    cpu->int_pending = r->int_pending;
+    cpu->sid = r->sid;
+    cpu->sod = r->sod;
+    cpu->ei_delay = r->ei_delay;
+#endif
+    memcpy(cpu->mem, k->mem, MEM_SIZE);
+}
+
+void keyframe_run_frames(CPU *cpu, uint64_t frames) {
+    for (uint64_t i = 0; i < frames && !cpu->exit; i++) {
+        for (int half = 0; half < 2 && !cpu->exit; half++) {
+            interrupt(cpu, 60);
+            run(cpu, CYCLES_PER_FRAME / 2, NULL);
+        }
+    }
+}
+
+keyframe_log* keyframe_create(const char *path, uint32_t rom_crc32, uint16_t base_addr, uint16_t flags, uint32_t interval) {
+    FILE *f = fopen(path, "wb");
+    keyframe_header h = {
+        .rom_crc32 = rom_crc32,
+        .base_addr = base_addr,
+        .flags = flags,
+        .interval = interval,
+        .record_size = sizeof(keyframe),
+    };
+    memcpy(h.magic, KEYFRAME_MAGIC, sizeof(h.magic));
+    if (f == NULL || fwrite(&h, sizeof(h), 1, f) != 1) {
+        if (f) fclose(f);
+        return NULL;
+    }
+    keyframe_log *log = calloc(1, sizeof(keyframe_log));
+    log->f = f;
+    log->scratch = malloc(sizeof(keyframe));
+    log->last_frame = UINT64_MAX;
+    return log;
+}
+
+bool keyframe_append(keyframe_log *log, const CPU *cpu, uint64_t frame, uint64_t input_applied) {
+    keyframe *k = log->scratch;
+    k->frame = frame;
+    k->input_applied = input_applied;
+    k->hash = state_hash(cpu);
+    keyframe_save(k, cpu);
+    if (fwrite(k, sizeof(keyframe), 1, log->f) != 1) return false;
+    log->count++;
+    log->last_frame = frame;
+    return true;
+}
+
+void keyframe_close(keyframe_log *log) {
+    fclose(log->f);
+    free(log->scratch);
+    free(log);
+}
+
+keyframe_file* keyframe_open(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(keyframe_header)) {
+        close(fd);
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const keyframe_header *h = map;
+    const size_t records = st.st_size - sizeof(*h);
+    if (memcmp(h->magic, KEYFRAME_MAGIC, sizeof(h->magic)) != 0
+            || h->record_size != sizeof(keyframe) || records % sizeof(keyframe) != 0) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    keyframe_file *kf = malloc(sizeof(keyframe_file));
+    kf->header = h;
+    kf->frames = (const keyframe*) (h + 1);
+    kf->count = records / sizeof(keyframe);
+    kf->map_size = st.st_size;
+    return kf;
+}
+
+void keyframe_file_close(keyframe_file *kf) {
+    munmap((void*) kf->header, kf->map_size);
+    free(kf);
+}
@@ -0,0 +1,100 @@
+#ifndef keyframe_h
+#define keyframe_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cpu.h"
+
+// Keyframes: the whole machine every n frames of a run (emu --keyframes),
+// registers, board state and all 64K, with a hash of it and how far into
+// the input recording the run had got. Any keyframe is a place to start
+// replaying from, the next one is what that replay has to end up at, so
+// emu-replayverify checks a long recording in independent segments, as
+// many at a time as there are cores.
+//
+// Only what decides what the machine does next is hashed: not the
+// instruction count, which the aot engine doesn't keep, nor the sound and
+// input hooks. Input that arrived after the last IN is still queued, not
+// in io_ports, input_applied is where the replay picks the queue up.
+//
+// The file is the header then fixed size records, little endian and
+// naturally aligned, mmap'ed as is.
+
+#define KEYFRAME_MAGIC "8080KEY1"
+
+#define KEYFRAME_CPM 0x01 // emu_cp_m_os was on
+
+typedef struct {
+    char magic[8];
+    uint32_t rom_crc32;
+    uint16_t base_addr;
+    uint16_t flags; // KEYFRAME_*
+    uint32_t interval; // frames between keyframes, the last one is wherever the run stopped
+    uint32_t record_size;
+    uint64_t reserved;
+} keyframe_header;
+
+// The CPU struct's state without its pointers, the same in 8080 and 8085 files
+typedef struct {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint16_t BC, DE, HL, sp, pc;
+    uint8_t A, f;
+    uint8_t io_ports[8];
+    uint8_t shift0, shift1, shift_offset;
+    bool interrupt_flag;
+    bool interrupts_disabled;
+    bool exit;
+    uint8_t int_mask, int_pending; // 8085 only
+    bool sid, sod;
+    uint8_t ei_delay;
+    uint8_t pad;
+} keyframe_regs;
+
+typedef struct {
+    uint64_t frame; // frames run before it
+    uint64_t input_applied; // events of the recording applied before it
+    uint64_t hash; // state_hash()
+    keyframe_regs regs;
+    uint8_t mem[MEM_SIZE];
+} keyframe;
+
+_Static_assert(sizeof(keyframe_header) == 32, "the file layout");
+_Static_assert(sizeof(keyframe_regs) == 48, "the file layout");
+_Static_assert(sizeof(keyframe) == 72 + MEM_SIZE, "the file layout");
+
+uint64_t state_hash(const CPU *cpu);
+
+void keyframe_save(keyframe *k, const CPU *cpu);
+// Into a machine from init(), sound and input are left alone
+void keyframe_restore(CPU *cpu, const keyframe *k);
+
+// Runs frames the way the frontend does, an interrupt and half a frame of
+// cycles twice per frame, until they're done or the rom exits
+void keyframe_run_frames(CPU *cpu, uint64_t frames);
+
+typedef struct {
+    FILE *f;
+    keyframe *scratch;
+    uint64_t count;
+    uint64_t last_frame;
+} keyframe_log;
+
+keyframe_log* keyframe_create(const char *path, uint32_t rom_crc32, uint16_t base_addr, uint16_t flags, uint32_t interval);
+bool keyframe_append(keyframe_log *log, const CPU *cpu, uint64_t frame, uint64_t input_applied);
+void keyframe_close(keyframe_log *log);
+
+typedef struct {
+    const keyframe_header *header;
+    const keyframe *frames;
+    uint64_t count;
+    size_t map_size;
+} keyframe_file;
+
+// NULL when path isn't a keyframe file
+keyframe_file* keyframe_open(const char *path);
+void keyframe_file_close(keyframe_file *kf);
+
+#endif
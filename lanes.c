@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "lanes.h"
+#include "cpu_ops.h"
+
+// Lanes that stopped running the same code make groups of one or two, and
+// 8 wide vector code for a single lane is slower than run(). Every WINDOW
+// steps the average group size is checked, below MIN_WIDTH the rest of the
+// budget is finished lane by lane with run(). The next lanes_run() tries
+// again, lanes reset or synced by the caller line up again.
+#define WINDOW 64
+#define MIN_WIDTH 2
+
+#define REG_H 4
+#define REG_L 5
+#define REG_M 6
+#define REG_A 7
+
+_Static_assert(LANES == 8, "lane_bits and the AVX2 gathers are written for 8 lanes");
+static const lane_u32 lane_bits = { 1, 2, 4, 8, 16, 32, 64, 128 };
+
+static inline lane_u32 mask_of(const uint32_t bits) {
+    return (lane_u32) ((lane_bits & bits) != 0);
+}
+
+static inline uint32_t bits_of(const lane_u32 m) {
+#ifdef __AVX2__
+    return _mm256_movemask_ps((__m256) m);
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < LANES; i++) {
+        bits |= (m[i] & 1) << i;
+    }
+    return bits;
+#endif
+}
+
+static inline lane_u32 sel(const lane_u32 m, const lane_u32 a, const lane_u32 b) {
+    return (a & m) | (b & ~m);
+}
+
+// The 4 bytes at addr of every lane's memory, little endian
+static inline lane_u32 gather32(const lanes *l, const lane_u32 addr) {
+#ifdef __AVX2__
+    const __m256i a = (__m256i) addr;
+    const __m256i lo = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*) &l->mem[0]),
+        _mm256_cvtepu32_epi64(_mm256_castsi256_si128(a)));
+    const __m256i hi = _mm256_add_epi64(_mm256_loadu_si256((const __m256i*) &l->mem[4]),
+        _mm256_cvtepu32_epi64(_mm256_extracti128_si256(a, 1)));
+    return (lane_u32) _mm256_set_m128i(_mm256_i64gather_epi32(NULL, hi, 1), _mm256_i64gather_epi32(NULL, lo, 1));
+#else
+    lane_u32 v;
+    for (int i = 0; i < LANES; i++) {
+        const uint8_t *p = (const uint8_t*) (uintptr_t) l->mem[i] + addr[i];
+        v[i] = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    }
+    return v;
+#endif
+}
+
+static inline lane_u32 load8(const lanes *l, const lane_u32 addr) {
+    return gather32(l, addr) & 0xff;
+}
+
+// No scatter in AVX2, stores go one lane at a time
+static inline void store8(lanes *l, uint32_t bits, const lane_u32 addr, const lane_u32 val) {
+    for (; bits; bits &= bits - 1) {
+        const int i = __builtin_ctz(bits);
+        ((uint8_t*) (uintptr_t) l->mem[i])[addr[i]] = val[i];
+    }
+}
+
+static inline lane_u32 pair(const lanes *l, const int hi) {
+    return (l->r[hi] << 8) | l->r[hi + 1];
+}
+
+static inline void set_pair(lanes *l, const int hi, const lane_u32 m, const lane_u32 v) {
+    l->r[hi] = sel(m, (v >> 8) & 0xff, l->r[hi]);
+    l->r[hi + 1] = sel(m, v & 0xff, l->r[hi + 1]);
+}
+
+// sign, zero and parity bits for a result, like setflags()
+static inline lane_u32 szp(const lane_u32 res) {
+    const lane_u32 v = res & 0xff;
+    lane_u32 p = v ^ (v >> 4);
+    p ^= p >> 2;
+    p ^= p >> 1;
+    return (v & F_SIGN) | ((lane_u32) (v == 0) & F_ZERO) | ((~p & 1) << 2);
+}
+
+// Jccc/Cccc/Rccc condition, bits 3-5 of the opcode
+static inline lane_u32 condition(const lanes *l, const uint8_t op) {
+    static const uint8_t flag[4] = { F_ZERO, F_CARRY, F_PARITY, F_SIGN };
+    const int c = (op >> 3) & 0x7;
+    const lane_u32 set = (lane_u32) ((l->f & flag[c >> 1]) != 0);
+    return c & 1 ? set : ~set;
+}
+
+// arithmetix(), kind is bits 3-5 of the opcode: ADD ADC SUB SBB ANA XRA ORA CMP
+static inline void alu(lanes *l, const lane_u32 m, const int kind, const lane_u32 val) {
+    const lane_u32 a = l->r[REG_A];
+    const lane_u32 carry = l->f & F_CARRY;
+    lane_u32 res;
+    switch (kind) {
+        case 0: res = a + val; break;
+        case 1: res = a + ((val + carry) & 0xff); break;
+        case 2: res = (a - val) & 0xffff; break;
+        case 3: res = (a - ((val + carry) & 0xff)) & 0xffff; break;
+        case 4: res = a & val; break;
+        case 5: res = a ^ val; break;
+        case 6: res = a | val; break;
+        default: res = (a - val) & 0xffff; break;
+    }
+    const lane_u32 c = (lane_u32) (res > 0xff) & F_CARRY;
+    l->f = sel(m, (l->f & ~(F_SIGN | F_ZERO | F_PARITY | F_CARRY)) | szp(res) | c, l->f);
+    if (kind != 7) {
+        l->r[REG_A] = sel(m, res & 0xff, a);
+    }
+}
+
+static inline void lane_push(lanes *l, const uint32_t bits, const lane_u32 m, const lane_u32 v) {
+    store8(l, bits, (l->sp - 1) & 0xffff, (v >> 8) & 0xff);
+    store8(l, bits, (l->sp - 2) & 0xffff, v & 0xff);
+    l->sp = sel(m, (l->sp - 2) & 0xffff, l->sp);
+}
+
+static inline lane_u32 lane_pop(lanes *l, const lane_u32 m) {
+    const lane_u32 v = load8(l, l->sp) | (load8(l, (l->sp + 1) & 0xffff) << 8);
+    l->sp = sel(m, (l->sp + 2) & 0xffff, l->sp);
+    return v;
+}
+
+static inline void lane_ret(lanes *l, uint32_t bits, const lane_u32 m) {
+    l->pc = sel(m, lane_pop(l, m), l->pc);
+    for (; bits; bits &= bits - 1) {
+        cpu_plugin_ret(l->pc[__builtin_ctz(bits)]);
+    }
+}
+
+// Runs op on the lanes in bits, returns the lanes left for exec()
+static uint32_t vector_op(lanes *l, const uint8_t op, uint32_t bits, const lane_u32 lo, const lane_u32 hi) {
+    const lane_u32 imm = (hi << 8) | lo;
+
+    // exec() quirks: CALL 5 is the cp/m BDOS trap, JMP 0 exits
+    uint32_t left = 0;
+    if (op == 0xcd) left = bits & bits_of((lane_u32) (imm == 5));
+    if (op == 0xc3) left = bits & bits_of((lane_u32) (imm == 0));
+    bits &= ~left;
+    if (bits == 0) return left;
+
+    const lane_u32 m = mask_of(bits);
+    lane_u32 *r = l->r;
+    lane_u32 taken = {}; // conditional branches that went through
+    int len = 1; // 0 when the op sets pc itself
+
+    switch (op) {
+        // NOP
+        case 0x00: break;
+        // LXI B/D/H
+        case 0x01: case 0x11: case 0x21: set_pair(l, ((op >> 4) & 3) * 2, m, imm); len = 3; break;
+        // LXI SP
+        case 0x31: l->sp = sel(m, imm, l->sp); len = 3; break;
+        // INX/DCX B/D/H
+        case 0x03: case 0x13: case 0x23: case 0x0b: case 0x1b: case 0x2b: {
+            const int p = ((op >> 4) & 3) * 2;
+            set_pair(l, p, m, (pair(l, p) + (op & 0x08 ? 0xffff : 1)) & 0xffff);
+            break;
+        }
+        // INX/DCX SP
+        case 0x33: l->sp = sel(m, (l->sp + 1) & 0xffff, l->sp); break;
+        case 0x3b: l->sp = sel(m, (l->sp - 1) & 0xffff, l->sp); break;
+        // INR/DCR r
+        case 0x04: case 0x0c: case 0x14: case 0x1c: case 0x24: case 0x2c: case 0x3c:
+        case 0x05: case 0x0d: case 0x15: case 0x1d: case 0x25: case 0x2d: case 0x3d: {
+            const int d = (op >> 3) & 7;
+            const lane_u32 v = (r[d] + (op & 1 ? 0xff : 1)) & 0xff;
+            r[d] = sel(m, v, r[d]);
+            l->f = sel(m, (l->f & ~(F_SIGN | F_ZERO | F_PARITY)) | szp(v), l->f);
+            break;
+        }
+        // MVI r
+        case 0x06: case 0x0e: case 0x16: case 0x1e: case 0x26: case 0x2e: case 0x3e: {
+            const int d = (op >> 3) & 7;
+            r[d] = sel(m, lo, r[d]);
+            len = 2;
+            break;
+        }
+        // RLC, RRC, RAL, RAR
+        case 0x07: case 0x0f: case 0x17: case 0x1f: {
+            const lane_u32 a = r[REG_A];
+            const lane_u32 c = l->f & F_CARRY;
+            lane_u32 res, carry;
+            switch (op) {
+                case 0x07: res = (a << 1) | (a >> 7); carry = a >> 7; break;
+                case 0x0f: res = (a >> 1) | (a << 7); carry = a & 1; break;
+                case 0x17: res = (a << 1) + c; carry = a >> 7; break;
+                default: res = (a >> 1) | (c << 7); carry = a & 1; break;
+            }
+            r[REG_A] = sel(m, res & 0xff, a);
+            l->f = sel(m, (l->f & ~F_CARRY) | carry, l->f);
+            break;
+        }
+        // DAD B/D/H/SP, carry out of the low byte like arithmetix_only_carry()
+        case 0x09: case 0x19: case 0x29: case 0x39: {
+            const lane_u32 rp = op == 0x39 ? l->sp : pair(l, ((op >> 4) & 3) * 2);
+            const lane_u32 res = (pair(l, REG_H) + rp) & 0xffff;
+            set_pair(l, REG_H, m, res);
+            l->f = sel(m, (l->f & ~F_CARRY) | ((lane_u32) (res > 0xff) & F_CARRY), l->f);
+            break;
+        }
+        // STAX B/D, LDAX B/D
+        case 0x02: case 0x12: store8(l, bits, pair(l, ((op >> 4) & 3) * 2), r[REG_A]); break;
+        case 0x0a: case 0x1a: r[REG_A] = sel(m, load8(l, pair(l, ((op >> 4) & 3) * 2)), r[REG_A]); break;
+        // SHLD, LHLD, the second byte isn't wrapped at 0xffff, same as exec()
+        case 0x22: store8(l, bits, imm, r[REG_L]); store8(l, bits, imm + 1, r[REG_H]); len = 3; break;
+        case 0x2a: {
+            const lane_u32 v = gather32(l, imm);
+            r[REG_L] = sel(m, v & 0xff, r[REG_L]);
+            r[REG_H] = sel(m, (v >> 8) & 0xff, r[REG_H]);
+            len = 3;
+            break;
+        }
+        // STA, LDA
+        case 0x32: store8(l, bits, imm, r[REG_A]); len = 3; break;
+        case 0x3a: r[REG_A] = sel(m, load8(l, imm), r[REG_A]); len = 3; break;
+        // CMA, STC, CMC
+        case 0x2f: r[REG_A] = sel(m, ~r[REG_A] & 0xff, r[REG_A]); break;
+        case 0x37: l->f = sel(m, l->f | F_CARRY, l->f); break;
+        case 0x3f: l->f = sel(m, l->f ^ F_CARRY, l->f); break;
+        // MOV
+        case 0x40 ... 0x75: case 0x77 ... 0x7f: {
+            const int d = (op >> 3) & 7, s = op & 7;
+            if (d == REG_M) {
+                store8(l, bits, pair(l, REG_H), r[s]);
+            } else {
+                r[d] = sel(m, s == REG_M ? load8(l, pair(l, REG_H)) : r[s], r[d]);
+            }
+            break;
+        }
+        // ADD ADC SUB SBB ANA XRA ORA CMP r/M
+        case 0x80 ... 0xbf: alu(l, m, (op >> 3) & 7, (op & 7) == REG_M ? load8(l, pair(l, REG_H)) : r[op & 7]); break;
+        // ADI ACI SUI SBI ANI XRI ORI CPI
+        case 0xc6: case 0xce: case 0xd6: case 0xde: case 0xe6: case 0xee: case 0xf6: case 0xfe:
+            alu(l, m, (op >> 3) & 7, lo);
+            len = 2;
+            break;
+        // JMP
+        case 0xc3: l->pc = sel(m, imm, l->pc); len = 0; break;
+        // Jccc
+        case 0xc2: case 0xca: case 0xd2: case 0xda: case 0xe2: case 0xea: case 0xf2: case 0xfa: {
+            const lane_u32 t = condition(l, op) & m;
+            l->pc = sel(t, imm, sel(m, (l->pc + 3) & 0xffff, l->pc));
+            taken = t;
+            len = 0;
+            break;
+        }
+        // CALL, Cccc
+        case 0xcd: case 0xc4: case 0xcc: case 0xd4: case 0xdc: case 0xe4: case 0xec: case 0xf4: case 0xfc: {
+            const lane_u32 t = op == 0xcd ? m : condition(l, op) & m;
+            lane_push(l, bits_of(t), t, (l->pc + 3) & 0xffff);
+            l->pc = sel(t, imm, sel(m, (l->pc + 3) & 0xffff, l->pc));
+            if (op != 0xcd) taken = t;
+            len = 0;
+            break;
+        }
+        // RET, Rccc
+        case 0xc9: case 0xc0: case 0xc8: case 0xd0: case 0xd8: case 0xe0: case 0xe8: case 0xf0: case 0xf8: {
+            const lane_u32 t = op == 0xc9 ? m : condition(l, op) & m;
+            l->pc = sel(m & ~t, (l->pc + 1) & 0xffff, l->pc);
+            lane_ret(l, bits_of(t), t);
+            if (op != 0xc9) taken = t;
+            len = 0;
+            break;
+        }
+        // PUSH B/D/H/PSW
+        case 0xc5: case 0xd5: case 0xe5: lane_push(l, bits, m, pair(l, ((op >> 4) & 3) * 2)); break;
+        case 0xf5: lane_push(l, bits, m, (r[REG_A] << 8) | l->f); break;
+        // POP B/D/H/PSW
+        case 0xc1: case 0xd1: case 0xe1: {
+            const int p = ((op >> 4) & 3) * 2;
+            set_pair(l, p, m, lane_pop(l, m));
+            break;
+        }
+        case 0xf1: {
+            const lane_u32 v = lane_pop(l, m);
+            r[REG_A] = sel(m, v >> 8, r[REG_A]);
+            l->f = sel(m, v & 0xff, l->f);
+            break;
+        }
+        // XCHG
+        case 0xeb: {
+            const lane_u32 hl = pair(l, REG_H);
+            set_pair(l, REG_H, m, pair(l, 2));
+            set_pair(l, 2, m, hl);
+            break;
+        }
+        // SPHL, PCHL
+        case 0xf9: l->sp = sel(m, pair(l, REG_H), l->sp); break;
+        case 0xe9: l->pc = sel(m, pair(l, REG_H), l->pc); len = 0; break;
+        default: return bits | left;
+    }
+
+    if (len) {
+        l->pc = sel(m, (l->pc + len) & 0xffff, l->pc);
+    }
+
+    const lane_u32 states = (opcodes[op].cycles + (taken & opcodes[op].taken)) & m;
+    l->cycles += __builtin_convertvector(states, lane_u64);
+    return left;
+}
+
+static void lane_from_cpu(lanes *l, const int i) {
+    const CPU *cpu = l->cpu[i];
+    l->r[0][i] = cpu->B;
+    l->r[1][i] = cpu->C;
+    l->r[2][i] = cpu->D;
+    l->r[3][i] = cpu->E;
+    l->r[REG_H][i] = cpu->H;
+    l->r[REG_L][i] = cpu->L;
+    l->r[REG_A][i] = cpu->A;
+    l->f[i] = *(const uint8_t*) &cpu->f;
+    l->sp[i] = cpu->sp;
+    l->pc[i] = cpu->pc;
+    l->cycles[i] = cpu->cycles;
+}
+
+static void lane_to_cpu(lanes *l, const int i) {
+    CPU *cpu = l->cpu[i];
+    cpu->B = l->r[0][i];
+    cpu->C = l->r[1][i];
+    cpu->D = l->r[2][i];
+    cpu->E = l->r[3][i];
+    cpu->H = l->r[REG_H][i];
+    cpu->L = l->r[REG_L][i];
+    cpu->A = l->r[REG_A][i];
+    const uint8_t f = l->f[i];
+    memcpy(&cpu->f, &f, sizeof(flags));
+    cpu->sp = l->sp[i];
+    cpu->pc = l->pc[i];
+    cpu->cycles = l->cycles[i];
+}
+
+lanes* lanes_open(CPU **cpus, int n) {
+#ifdef __AVX2__
+    if (!__builtin_cpu_supports("avx2")) {
+        return NULL;
+    }
+#endif
+    if (n < 1 || n > LANES) {
+        return NULL;
+    }
+
+    lanes *l = aligned_alloc(sizeof(lane_u32), sizeof(lanes));
+    memset(l, 0, sizeof(lanes));
+    l->n = n;
+    for (int i = 0; i < LANES; i++) {
+        // idle lanes gather from lane 0 and never store
+        l->cpu[i] = cpus[i < n ? i : 0];
+        l->mem[i] = (uintptr_t) l->cpu[i]->mem;
+    }
+    return l;
+}
+
+void lanes_close(lanes *l) {
+    free(l);
+}
+
+void lanes_run(lanes *l, const uint64_t cycles) {
+    for (int i = 0; i < l->n; i++) {
+        lane_from_cpu(l, i);
+    }
+    // idle lanes never start, the others until the budget is spent or exec() exits them
+    const lane_u64 end = l->cycles + cycles;
+    uint32_t exited = ~0u << l->n;
+    for (int i = 0; i < l->n; i++) {
+        if (l->cpu[i]->exit) exited |= 1 << i;
+    }
+
+    uint64_t window_ops = l->vector_ops + l->scalar_ops, window_groups = l->groups;
+    for (int step = 1; ; step++) {
+        const uint32_t active = bits_of((lane_u32) __builtin_convertvector(l->cycles < end, lane_u32)) & ~exited;
+        if (active == 0) break;
+
+        if (step % WINDOW == 0) {
+            const uint64_t ops = l->vector_ops + l->scalar_ops;
+            if (ops - window_ops < (l->groups - window_groups) * MIN_WIDTH) {
+                for (uint32_t b = active; b; b &= b - 1) {
+                    const int i = __builtin_ctz(b);
+                    lane_to_cpu(l, i);
+                    run(l->cpu[i], end[i] - l->cycles[i], NULL);
+                    lane_from_cpu(l, i);
+                }
+                l->diverged++;
+                break;
+            }
+            window_ops = ops;
+            window_groups = l->groups;
+        }
+
+        const lane_u32 word = gather32(l, l->pc);
+        const lane_u32 ops = word & 0xff;
+        const lane_u32 lo = (word >> 8) & 0xff;
+        const lane_u32 hi = (word >> 16) & 0xff;
+
+        uint32_t todo = active;
+        while (todo) {
+            const uint8_t op = ops[__builtin_ctz(todo)];
+            const uint32_t group = todo & bits_of((lane_u32) (ops == op));
+            todo &= ~group;
+            l->groups++;
+
+#ifdef CPU_8085
+            // the instruction after EI goes through exec(), which counts
+            // ei_delay down and takes a pending interrupt after it
+            uint32_t delayed = 0;
+            for (uint32_t b = group; b; b &= b - 1) {
+                if (l->cpu[__builtin_ctz(b)]->ei_delay) delayed |= b & -b;
+            }
+            const uint32_t left = vector_op(l, op, group & ~delayed, lo, hi) | delayed;
+#else
+            const uint32_t left = vector_op(l, op, group, lo, hi);
+#endif
+            l->vector_ops += __builtin_popcount(group & ~left);
+            for (uint32_t b = left; b; b &= b - 1) {
+                const int i = __builtin_ctz(b);
+                lane_to_cpu(l, i);
+                exec(l->cpu[i]);
+                lane_from_cpu(l, i);
+                if (l->cpu[i]->exit) exited |= 1 << i;
+                l->scalar_ops++;
+            }
+        }
+    }
+
+    for (int i = 0; i < l->n; i++) {
+        lane_to_cpu(l, i);
+    }
+}
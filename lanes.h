@@ -0,0 +1,49 @@
+#ifndef lanes_h
+#define lanes_h
+
+#include <stdint.h>
+#include "cpu.h"
+
+// Experimental engine for batch runs of many machines. LANES machines step
+// in lockstep with their hot registers in structure-of-arrays form, one
+// vector per register. Each step gathers the next instruction of every
+// lane, groups the lanes by opcode and runs each group with vector code.
+// Ops without a vector version (IN/OUT, EI/DI, XTHL, RST, DAA, ...) and
+// lanes that would hit the cp/m CALL 5 or the JMP 0 exit go through exec()
+// on that lane's own CPU, so the result is always what exec() would do. On
+// the 8085 so does the instruction after EI, interrupts are polled after it.
+//
+// Memory stays in every machine's CPU, loads are AVX2 gathers when built
+// with -mavx2 and plain loops otherwise. The CPUs are the real state
+// between lanes_run() calls, interrupts and input go to them as usual.
+
+#define LANES 8
+
+typedef uint32_t lane_u32 __attribute__((vector_size(LANES * sizeof(uint32_t))));
+typedef uint64_t lane_u64 __attribute__((vector_size(LANES * sizeof(uint64_t))));
+
+typedef struct {
+    lane_u32 r[8]; // by the 8080's register codes: B C D E H L (M) A
+    lane_u32 f; // flags byte, same bits as CPU.f
+    lane_u32 sp;
+    lane_u32 pc;
+    lane_u64 cycles;
+    uint64_t mem[LANES]; // address of every lane's memory
+    CPU *cpu[LANES];
+    int n; // lanes in use, the rest idle
+
+    uint64_t groups; // opcode groups executed
+    uint64_t vector_ops; // lane instructions run by vector code
+    uint64_t scalar_ops; // lane instructions run by exec()
+    uint64_t diverged; // lanes_run() calls finished lane by lane
+} lanes;
+
+// Up to LANES machines, NULL when the host lacks what the build needs
+lanes* lanes_open(CPU **cpus, int n);
+void lanes_close(lanes *l);
+
+// Runs every lane until it spent the cycle budget or exited, like run()
+// without stop conditions on each machine
+void lanes_run(lanes *l, const uint64_t cycles);
+
+#endif
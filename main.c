@@ -11,15 +11,26 @@
 #include "interrupts.h"
 #include "gfx.h"
 #include "io.h"
+#include "audio.h"
 
-#include "disass.h"
-
-#define DEBUG 0
-#define TRACE 0
+#include "trace.h"
+#include "sound.h"
+#include "debugger.h"
+#include "rom.h"
+#include "fbring.h"
+#include "capture.h"
+#include "framehash.h"
+#include "input.h"
+#include "metrics.h"
+#include "memstats.h"
+#include "blockindex.h"
+#include "keyframe.h"
+#ifdef AOT
+#include "aot.h"
+#endif
 
 #define ENABLE_INTERRUPTS
 
-#define TICKS_PER_FRAME 1500 // how many?? todo: get rid of this one and do as many as we can in a frame!
 #define FRAMES_PER_SECOND 60 // 0.1 = 10 sec per frame
 
 #define ONE_SECOND_IN_MICRO 1000000
@@ -31,105 +42,490 @@ uint64_t gettimestamp_micro() {
 	return (uint64_t) (1000000 * tv.tv_sec) + tv.tv_usec;
 }
 
+static run_reason run_plain(CPU* cpu, const uint64_t cycles) {
+    return run(cpu, cycles, NULL);
+}
+
+// A frame on the fast path, for run-ahead
+static void run_frame(CPU *cpu, run_reason (*runner)(CPU*, const uint64_t)) {
+    for (int half = 0; half < 2 && !cpu->exit; half++) {
+        #ifdef ENABLE_INTERRUPTS
+            interrupt(cpu, FRAMES_PER_SECOND);
+        #endif
+        runner(cpu, CYCLES_PER_FRAME / 2);
+    }
+}
+
 int main(int argc, char **argv) {
-    if (argc != 4) {
-        printf("usage: %s [rom] [$base_addr] [emu_cpm_os:1|0]", argv[0]);
+    if (argc < 4) {
+        printf("usage: %s [rom] [$base_addr] [emu_cpm_os:1|0] [--trace file] [--headless] [--frames n] "
+               "[--wav file] [--samples dir] [--mute] [--debug socket] [--export shm_name] "
+               "[--capture file.y4m|file.raw] [--stills n] [--capture-drop] [--hashes file] [--runahead n] "
+               "[--record file] [--replay file] [--metrics file] [--metrics-socket path] "
+               "[--memstats file.csv] [--blocks file.blk] [--keyframes file] [--keyframe-every n]", argv[0]);
         exit(1);
     }
 
-    FILE *f = fopen(argv[1], "rb");
-    if (f == NULL) {
-        printf("fopen");
-        exit(1);
+    const char *trace_path = NULL;
+    const char *wav_path = NULL;
+    const char *samples_dir = NULL;
+    const char *debug_socket = NULL;
+    const char *export_name = NULL;
+    const char *capture_path = NULL;
+    int stills_every = 0;
+    bool capture_drop = false;
+    const char *hashes_path = NULL;
+    int runahead = 0;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *metrics_path = NULL;
+    const char *metrics_socket = NULL;
+    const char *memstats_path = NULL;
+    const char *blocks_path = NULL;
+    const char *keyframes_path = NULL;
+    uint32_t keyframe_every = 600;
+    bool headless = false;
+    bool mute = false;
+    uint64_t max_frames = 0; // 0 = until the rom or the user exits
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true; // no window, no input, no throttling
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+            wav_path = argv[++i];
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            samples_dir = argv[++i];
+        } else if (strcmp(argv[i], "--mute") == 0) {
+            mute = true;
+        } else if (strcmp(argv[i], "--debug") == 0 && i + 1 < argc) {
+            debug_socket = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            export_name = argv[++i]; // frames for emu-fbview and friends
+        } else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (strcmp(argv[i], "--stills") == 0 && i + 1 < argc) {
+            stills_every = atoi(argv[++i]); // a PNG every n frames next to the capture
+        } else if (strcmp(argv[i], "--capture-drop") == 0) {
+            capture_drop = true; // drop frames rather than wait for the encoder
+        } else if (strcmp(argv[i], "--hashes") == 0 && i + 1 < argc) {
+            hashes_path = argv[++i]; // per frame VRAM hashes, for emu-framecmp
+        } else if (strcmp(argv[i], "--runahead") == 0 && i + 1 < argc) {
+            runahead = atoi(argv[++i]); // show the frame n frames from now
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_path = argv[++i]; // the input, with the cycles it landed on
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_path = argv[++i]; // a recording instead of the keyboard
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_path = argv[++i]; // Prometheus text, on SIGUSR1 and at exit
+        } else if (strcmp(argv[i], "--metrics-socket") == 0 && i + 1 < argc) {
+            metrics_socket = argv[++i]; // the same, to whoever connects
+        } else if (strcmp(argv[i], "--memstats") == 0 && i + 1 < argc) {
+            memstats_path = argv[++i]; // per page accesses and stack depth, slow
+        } else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) {
+            blocks_path = argv[++i]; // emu-analyze's index of the rom
+        } else if (strcmp(argv[i], "--keyframes") == 0 && i + 1 < argc) {
+            keyframes_path = argv[++i]; // the whole machine every n frames, for emu-replayverify
+        } else if (strcmp(argv[i], "--keyframe-every") == 0 && i + 1 < argc) {
+            keyframe_every = strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("unknown option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+
+    tracer *trace = NULL;
+    if (trace_path) {
+        trace = trace_open(trace_path);
+        if (trace == NULL) {
+            printf("trace_open %s\n", trace_path);
+            exit(1);
+        }
     }
 
     uint16_t base_addr = strtol(argv[2], NULL, 16);
     emu_cp_m_os = atoi(argv[3]);
-    printf("rom: %s, base_addr: 0x%04x (%dd), emu_cp_m_os: %d\n", argv[1], base_addr, base_addr, emu_cp_m_os);
 
-    fseek(f, 0L, SEEK_END);
-    int fsize = ftell(f);
-    fseek(f, 0L, SEEK_SET);
+    // a single image or a directory with a split rom set (invaders.h/g/f/e)
+    rom_image *rom = rom_open(argv[1], base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[1]);
+        exit(1);
+    }
+    printf("rom: %s%s%s, size: %zu, crc32: %08x, base_addr: 0x%04x (%dd), emu_cp_m_os: %d\n", argv[1],
+        rom->set ? " set " : "", rom->set ? rom->set : "", rom->size, rom->crc32, base_addr, base_addr, emu_cp_m_os);
 
     CPU *cpu = init(base_addr);
+    rom_load(cpu, rom);
+
+    // the rom's code pages mapped now rather than faulting in during the first frames
+    if (blocks_path) {
+        block_index *idx = block_index_open(blocks_path);
+        if (idx == NULL) {
+            printf("block_index_open %s\n", blocks_path);
+            exit(1);
+        }
+        if (idx->header->rom_crc32 != rom->crc32 || idx->header->base_addr != base_addr) {
+            printf("%s: an index of another rom (crc32 %08x, base_addr 0x%04x)\n", blocks_path,
+                idx->header->rom_crc32, idx->header->base_addr);
+            exit(1);
+        }
+        printf("blocks: %u, code: %u of %u bytes, %d pages prewarmed\n", idx->header->num_blocks,
+            idx->header->code_bytes, idx->header->rom_size, block_index_prewarm(idx, cpu->mem));
+        block_index_close(idx);
+    }
+
+#ifdef AOT
+    // the generated code is only worth anything for the rom it came from
+    const bool aot = rom->crc32 == aot_rom_crc32 && base_addr == aot_base_addr;
+    printf("aot: %s\n", aot ? aot_rom : "not the recompiled rom, interpreting");
+#endif
+
+    if (!headless) {
+        init_sdl(argv[1]);
+    }
+
+    // realtime audio only with a window, headless renders to the wav file
+    sound *snd = NULL;
+    if (wav_path || (!headless && !mute)) {
+        snd = sound_init(samples_dir);
+        if (snd == NULL) {
+            printf("sound_init: out of memory\n");
+            exit(1);
+        }
+        cpu->sound = snd;
+    }
+    if (wav_path && !sound_wav_open(snd, wav_path)) {
+        printf("sound_wav_open %s\n", wav_path);
+        exit(1);
+    }
+    if (snd && !wav_path && !init_audio(snd)) {
+        printf("no audio device, running silent\n");
+    }
+
+    debugger *dbg = NULL;
+    if (debug_socket) {
+        dbg = debugger_open(debug_socket, cpu);
+        if (dbg == NULL) {
+            printf("debugger_open %s\n", debug_socket);
+            exit(1);
+        }
+    }
+
+    fbring *fb = NULL;
+    if (export_name) {
+        fb = fbring_create(export_name);
+        if (fb == NULL) {
+            printf("fbring_create %s\n", export_name);
+            exit(1);
+        }
+    }
+
+    capture *cap = NULL;
+    if (capture_path) {
+        cap = capture_open(capture_path, stills_every, capture_drop);
+        if (cap == NULL) {
+            printf("capture_open %s\n", capture_path);
+            exit(1);
+        }
+    }
+
+    framehash_log *hashes = NULL;
+    if (hashes_path) {
+        hashes = framehash_create(hashes_path);
+        if (hashes == NULL) {
+            printf("framehash_create %s\n", hashes_path);
+            exit(1);
+        }
+    }
 
-    uint8_t program[fsize];
-    fread(program, fsize, 1, f);
-    load(cpu, base_addr, program, fsize);
-    fclose(f);
+    keyframe_log *keyframes = NULL;
+    if (keyframes_path) {
+        if (keyframe_every == 0) {
+            printf("--keyframe-every %u\n", keyframe_every);
+            exit(1);
+        }
+        keyframes = keyframe_create(keyframes_path, rom->crc32, base_addr, emu_cp_m_os ? KEYFRAME_CPM : 0, keyframe_every);
+        if (keyframes == NULL) {
+            printf("keyframe_create %s\n", keyframes_path);
+            exit(1);
+        }
+    }
+
+    // the keyboard queues into this, IN applies it at the cycles it's due
+    input *in = NULL;
+    if (replay_path) {
+        in = input_replay(replay_path);
+        if (in == NULL) {
+            printf("input_replay %s\n", replay_path);
+            exit(1);
+        }
+    } else if (!headless || record_path) {
+        in = input_open(record_path);
+        if (in == NULL) {
+            printf("input_open %s\n", record_path);
+            exit(1);
+        }
+    }
+    cpu->input = in;
+
+    metrics *stats = NULL;
+    if (metrics_path || metrics_socket) {
+        stats = metrics_open(metrics_path, metrics_socket);
+        if (stats == NULL) {
+            printf("metrics_open %s\n", metrics_socket);
+            exit(1);
+        }
+    }
+    uint64_t counted_instructions = 0, counted_cycles = 0;
+
+    memstats *mem = NULL;
+    if (memstats_path) {
+        mem = memstats_open(memstats_path, cpu);
+        if (mem == NULL) {
+            printf("memstats_open %s\n", memstats_path);
+            exit(1);
+        }
+    }
 
-    init_sdl(argv[1]);
+    // Run-ahead: after every real frame the machine is copied to a scratch
+    // one, which runs n frames further with the input just read, and that
+    // future frame is what's shown. Copying to scratch is the snapshot and
+    // the restore in one, the real machine never leaves its timeline, so
+    // sound, traces, captures and hashes don't change with it.
+    CPU *ahead = NULL;
+    run_reason (*run_ahead)(CPU*, const uint64_t) = run_plain;
+    uint64_t emulation_us = 0, ahead_us = 0, worst_us = 0;
+    if (runahead > 0) {
+        ahead = init(base_addr);
+#ifdef AOT
+        if (aot) {
+            run_ahead = aot_run;
+        }
+#endif
+    }
 
-    uint64_t totalticks = 0;
+    uint64_t frames = 0;
     bool user_exit = false;
     while(!cpu->exit && !user_exit) { 
         uint64_t frame_start_ts = gettimestamp_micro();
 
-        user_exit = handle_user_input(cpu);
+        if (!headless) {
+            user_exit = handle_user_input(cpu, in);
+        }
 
-        #ifdef ENABLE_INTERRUPTS
-            interrupt(cpu, FRAMES_PER_SECOND); // TODO: is this the place to interrupt???? 
-        #endif
+        if (dbg) {
+            debugger_poll(dbg, cpu);
+        }
 
-        char curr_op_dissasd[128];
-        for (int tick = 0; tick < TICKS_PER_FRAME; tick++) {
-            if (cpu->exit || user_exit) break;
+        // at the frame boundary, after anything the debugger changed
+        if (keyframes && frames % keyframe_every == 0) {
+            keyframe_append(keyframes, cpu, frames, in ? in->applied : 0);
+        }
 
-            if (DEBUG) {
-                // print interrupt indicator
-                for (size_t i = 0; i < num_active_interrupts; i++) {
-                    printf("-");
+        const uint64_t emulation_start = gettimestamp_micro();
+        const uint64_t emulation_start_ns = stats ? metrics_now() : 0;
+        // mid-screen and vblank interrupt, each followed by half a frame
+        for (int half = 0; half < 2 && !cpu->exit && !user_exit; half++) {
+            #ifdef ENABLE_INTERRUPTS
+                if (stats) {
+                    metrics_add(stats, cpu->interrupts_disabled ? METRIC_INTERRUPTS_DROPPED : METRIC_INTERRUPTS_TAKEN, 1);
                 }
-                if (num_active_interrupts > 0) {
-                    printf(">");
+                if (mem) {
+                    memstats_interrupt(mem, cpu);
                 }
+                interrupt(cpu, FRAMES_PER_SECOND);
+            #endif
 
-                disass(curr_op_dissasd, cpu->mem, cpu->pc);
-                printf("%s\n", curr_op_dissasd);
+            const uint64_t end = cpu->cycles + CYCLES_PER_FRAME / 2;
+            // only pay for the debugger, the tracer and memstats while they're in use
+            bool debug_armed = dbg && debugger_armed(dbg);
+            if (!debug_armed && !trace && !mem) {
+#ifdef AOT
+                if (aot) {
+                    aot_run(cpu, CYCLES_PER_FRAME / 2);
+                    continue;
+                }
+#endif
+                run(cpu, CYCLES_PER_FRAME / 2, NULL);
+                continue;
             }
 
-            if (TRACE) {
-                printf("0x%04x -> ", cpu->pc);
+            while (cpu->cycles < end && !cpu->exit) {
+                if (debug_armed) {
+                    debugger_check(dbg, cpu);
+                    debug_armed = debugger_armed(dbg);
+                    if (cpu->exit) break;
+                }
+
+                if (trace) {
+                    trace_exec(trace, cpu);
+                }
+                if (mem) {
+                    memstats_exec(mem, cpu);
+                }
+
+                exec(cpu);
             }
+        }
 
-            // tick
-            exec(cpu);
-            totalticks++;
-
-            if (TRACE) {
-                // const uint8_t *flags = (uint8_t*) &cpu->f;
-                printf("0x%02x\n", cpu->A);
-                printf("F = c:%x, p:%x, ac:%x, z:%x, s:%x\n", cpu->f.carry, cpu->f.parity, cpu->f.auxcarry, cpu->f.zero, cpu->f.sign);
-                // printf("stack: ");
-                // uint8_t *s = &cpu->mem[cpu->sp];
-                // while (*s != '\0') printf("0x%02x ", *s++); // TODO: wrong? what if stack contains a 0x00??? ITS VALID!
-                // printf("\n");
+        const uint64_t emulation_end = gettimestamp_micro();
+        emulation_us += emulation_end - emulation_start;
+        if (mem) {
+            memstats_frame(mem);
+        }
+        if (stats) {
+            metrics_record(stats, METRIC_EMULATION, metrics_now() - emulation_start_ns);
+            metrics_add(stats, METRIC_INSTRUCTIONS, cpu->instructions - counted_instructions);
+            metrics_add(stats, METRIC_CYCLES, cpu->cycles - counted_cycles);
+            metrics_add(stats, METRIC_FRAMES, 1);
+            counted_instructions = cpu->instructions;
+            counted_cycles = cpu->cycles;
+            metrics_poll(stats);
+        }
+
+        if (snd) {
+            sound_sync(snd, cpu->cycles);
+            if (wav_path) {
+                sound_render(snd, cpu->cycles);
             }
         }
 
-        #ifdef ENABLE_INTERRUPTS
-            interrupt(cpu, FRAMES_PER_SECOND); // TODO: is this the place to interrupt???? 
-        #endif
+        if (fb) {
+            fbring_publish(fb, &cpu->mem[FBRING_VRAM], cpu->cycles);
+        }
+        if (cap) {
+            capture_frame(cap, &cpu->mem[CAPTURE_VRAM]);
+        }
+        if (hashes) {
+            framehash_append(hashes, &cpu->mem[FRAMEHASH_VRAM]);
+        }
+
+        uint8_t *present = &cpu->mem[0x2400];
+        if (ahead && !cpu->exit) {
+            const uint64_t ahead_start = gettimestamp_micro();
+            copy_cpu(ahead, cpu);
+            ahead->sound = NULL; // heard once, when the real machine gets there
+            ahead->input = NULL; // the queue is the real machine's, hold what's in it
+            if (in) {
+                input_ahead(in, ahead);
+            }
+            for (int i = 0; i < runahead && !ahead->exit; i++) {
+                run_frame(ahead, run_ahead);
+            }
+            present = &ahead->mem[0x2400];
 
-        render_sdl(&cpu->mem[0x2400]);
+            const uint64_t ahead_end = gettimestamp_micro();
+            ahead_us += ahead_end - ahead_start;
+            if (ahead_end - emulation_start > worst_us) {
+                worst_us = ahead_end - emulation_start;
+            }
+        }
+
+        frames++;
+        if (max_frames && frames >= max_frames) {
+            break;
+        }
+
+        if (headless) {
+            continue;
+        }
+
+        const uint64_t render_start_ns = stats ? metrics_now() : 0;
+        render_sdl(present);
+        const uint64_t present_start_ns = stats ? metrics_now() : 0;
+        present_sdl();
+        if (stats) {
+            const uint64_t present_end_ns = metrics_now();
+            metrics_record(stats, METRIC_RENDER, present_start_ns - render_start_ns);
+            metrics_record(stats, METRIC_PRESENT, present_end_ns - present_start_ns);
+        }
 
         uint64_t frame_end_ts = gettimestamp_micro();
         uint64_t elapsed = frame_end_ts - frame_start_ts;
         // printf("frame end: %llu\n", frame_end_ts);
         // printf("frame took: %llu\n", elapsed);
         if (elapsed < FRAMES_PER_MICROSECOND) {
-            SDL_Delay((FRAMES_PER_MICROSECOND - elapsed) / 1000);
+            const uint32_t delay_ms = (FRAMES_PER_MICROSECOND - elapsed) / 1000;
+            const uint64_t sleep_start_ns = stats ? metrics_now() : 0;
+            SDL_Delay(delay_ms);
+            if (stats) {
+                const uint64_t slept_ns = metrics_now() - sleep_start_ns;
+                metrics_record(stats, METRIC_SLEEP_OVERSHOOT, slept_ns > delay_ms * 1000000ULL ? slept_ns - delay_ms * 1000000ULL : 0);
+            }
+        } else if (stats) {
+            metrics_add(stats, METRIC_DEADLINE_MISSES, 1);
+        }
+    }
+
+    // where the run stopped ends the last segment, unless the window closed
+    // before the frame it was counting ran
+    if (keyframes) {
+        if (!user_exit && keyframes->last_frame != frames) {
+            keyframe_append(keyframes, cpu, frames, in ? in->applied : 0);
         }
+        printf("keyframes: %llu, every %u frames\n", (unsigned long long) keyframes->count, keyframe_every);
+        keyframe_close(keyframes);
     }
 
     if (emu_cp_m_os) {
         printf("CP/M OUT: %s\n", emu_cp_m_os_output);
     }
 
-    // free(cpu->memory);
-    printf("cleaning up! total ticks: %llu\n", totalticks);
-    destroy_sdl();
-    free(cpu);
+    if (ahead && frames) {
+        // emulated frames per real one, and how far ahead that leaves room for
+        const double budget = FRAMES_PER_MICROSECOND;
+        const double emulation = (double) emulation_us / frames, extra = (double) ahead_us / frames;
+        printf("run-ahead %d: %llu frames, emulation %.1f us/frame, run-ahead %.1f us/frame, worst %llu us, "
+               "headroom %.1fx (%.1fx worst), room for ~%.0f frames ahead\n", runahead,
+            (unsigned long long) frames, emulation, extra, (unsigned long long) worst_us,
+            budget / (emulation + extra), worst_us ? budget / worst_us : 0.0,
+            extra > 0 ? (budget - emulation) / (extra / runahead) : 0.0);
+        free_cpu(ahead);
+    }
+
+    printf("cleaning up! total cycles: %llu\n", (unsigned long long) cpu->cycles);
+    if (snd) {
+        destroy_audio();
+        if (wav_path) {
+            sound_wav_close(snd);
+        }
+        sound_free(snd);
+    }
+    if (!headless) {
+        destroy_sdl();
+    }
+    if (trace) {
+        trace_close(trace);
+    }
+    if (mem) {
+        memstats_close(mem);
+    }
+    if (dbg) {
+        debugger_close(dbg);
+    }
+    if (fb) {
+        fbring_destroy(fb, export_name);
+    }
+    if (cap) {
+        capture_close(cap);
+    }
+    if (stats) {
+        metrics_close(stats);
+    }
+    if (in) {
+        if (record_path || replay_path) {
+            printf("input: %llu events applied\n", (unsigned long long) in->applied);
+        }
+        input_close(in);
+    }
+    if (hashes) {
+        framehash_close(hashes);
+    }
+    free_cpu(cpu);
+    rom_close(rom);
 
     return 0;
 }
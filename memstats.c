@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "memstats.h"
+
+memstats* memstats_open(const char *csv_path, const CPU *cpu) {
+    FILE *out = fopen(csv_path, "w");
+    if (out == NULL) return NULL;
+    fprintf(out, "frame,reads,writes,bytes_written,vram_bytes_written,vram_pages_written,min_sp\n");
+
+    memstats *s = calloc(1, sizeof(memstats));
+    s->out = out;
+    s->start_sp = s->min_sp = s->frame_min_sp = cpu->sp;
+    s->min_sp_pc = cpu->pc;
+    return s;
+}
+
+void memstats_frame(memstats *s) {
+    int bytes = 0, vram_bytes = 0, vram_pages = 0;
+    for (int page = 0; page < MEMSTATS_PAGES; page++) {
+        int n = 0;
+        for (int i = page * 32; i < page * 32 + 32; i++) {
+            n += __builtin_popcount(s->written[i]);
+        }
+        bytes += n;
+        if (page >= MEMSTATS_VRAM >> 8 && page < MEMSTATS_VRAM_END >> 8) {
+            vram_bytes += n;
+            vram_pages += n > 0;
+        }
+    }
+    fprintf(s->out, "%llu,%llu,%llu,%d,%d,%d,0x%04x\n", (unsigned long long) s->frames,
+        (unsigned long long) s->frame_reads, (unsigned long long) s->frame_writes, bytes, vram_bytes, vram_pages,
+        s->frame_min_sp);
+
+    memset(s->written, 0, sizeof(s->written));
+    s->frame_reads = s->frame_writes = 0;
+    s->frame_min_sp = 0xffff;
+    s->frames++;
+}
+
+// One character per page, 16 pages a row, darker is hotter on a log scale
+static void heatmap(const char *title, const uint64_t *counts) {
+    static const char shades[] = " .:-=+*#%@";
+    uint64_t max = 0;
+    for (int page = 0; page < MEMSTATS_PAGES; page++) {
+        if (counts[page] > max) max = counts[page];
+    }
+
+    printf("%s (max %llu per page, log scale \"%s\")\n", title, (unsigned long long) max, shades);
+    printf("      0123456789abcdef\n");
+    for (int row = 0; row < 16; row++) {
+        printf("  %x0  ", row);
+        for (int col = 0; col < 16; col++) {
+            const uint64_t n = counts[row * 16 + col];
+            int shade = 0;
+            if (n) {
+                shade = 1 + (int) ((sizeof(shades) - 2) * log((double) n) / log((double) max + 1));
+            }
+            putchar(shades[shade]);
+        }
+        putchar('\n');
+    }
+}
+
+void memstats_close(memstats *s) {
+    fclose(s->out);
+
+    printf("memstats: %llu frames\n", (unsigned long long) s->frames);
+    heatmap("instructions executed, by page (high byte: row, column)", s->fetches);
+    heatmap("bytes read", s->reads);
+    heatmap("bytes written", s->writes);
+
+    // the hottest pages, all kinds of access together
+    int top[8] = { -1, -1, -1, -1, -1, -1, -1, -1 };
+    for (int page = 0; page < MEMSTATS_PAGES; page++) {
+        const uint64_t n = s->fetches[page] + s->reads[page] + s->writes[page];
+        if (n == 0) continue;
+        for (int k = 0; k < 8; k++) {
+            const int t = top[k];
+            if (t < 0 || n > s->fetches[t] + s->reads[t] + s->writes[t]) {
+                memmove(&top[k + 1], &top[k], (7 - k) * sizeof(int));
+                top[k] = page;
+                break;
+            }
+        }
+    }
+    printf("hottest pages:\n");
+    for (int k = 0; k < 8 && top[k] >= 0; k++) {
+        const int page = top[k];
+        printf("  0x%02x00  %12llu fetched %12llu read %12llu written\n", page,
+            (unsigned long long) s->fetches[page], (unsigned long long) s->reads[page],
+            (unsigned long long) s->writes[page]);
+    }
+
+    printf("stack: started at 0x%04x, lowest 0x%04x (%d bytes deep) at pc 0x%04x\n", s->start_sp, s->min_sp,
+        s->start_sp - s->min_sp, s->min_sp_pc);
+    free(s);
+}
@@ -0,0 +1,83 @@
+#ifndef memstats_h
+#define memstats_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include "cpu.h"
+
+// Memory access instrumentation: instruction fetches, reads and writes per
+// 256 byte page, the bytes written every frame and the lowest the stack
+// pointer got. memstats_exec() goes before every instruction on main.c's
+// stepping path, like the tracer, so it costs nothing while it's off.
+//
+// Every frame is a line of CSV: accesses, how many distinct bytes were
+// written, how many of them VRAM, and the frame's lowest SP. At the end a
+// heatmap of the pages and the stack's high-water mark are printed.
+
+#define MEMSTATS_PAGES 256
+#define MEMSTATS_VRAM 0x2400
+#define MEMSTATS_VRAM_END 0x4000
+
+typedef struct {
+    // whole run
+    uint64_t fetches[MEMSTATS_PAGES]; // instructions executed from the page
+    uint64_t reads[MEMSTATS_PAGES];
+    uint64_t writes[MEMSTATS_PAGES];
+    uint16_t start_sp;
+    uint16_t min_sp;
+    uint16_t min_sp_pc; // where it got there
+
+    // this frame
+    uint8_t written[0x10000 / 8]; // bitmap of bytes written
+    uint64_t frame_reads;
+    uint64_t frame_writes;
+    uint16_t frame_min_sp;
+
+    FILE *out;
+    uint64_t frames;
+} memstats;
+
+memstats* memstats_open(const char *csv_path, const CPU *cpu);
+// Prints the heatmap and the high-water mark
+void memstats_close(memstats *s);
+
+// After each frame
+void memstats_frame(memstats *s);
+
+static inline void memstats_exec(memstats *s, const CPU *cpu) {
+    accesses acc;
+    decode_accesses(cpu, &acc);
+    s->fetches[cpu->pc >> 8]++;
+    for (int i = 0; i < acc.read_len; i++) {
+        s->reads[(uint16_t) (acc.read + i) >> 8]++;
+    }
+    for (int i = 0; i < acc.write_len; i++) {
+        const uint16_t addr = acc.write + i;
+        s->writes[addr >> 8]++;
+        s->written[addr >> 3] |= 1 << (addr & 7);
+    }
+    s->frame_reads += acc.read_len;
+    s->frame_writes += acc.write_len;
+
+    // the SP an instruction starts with, pushes by interrupts included
+    if (cpu->sp < s->frame_min_sp) {
+        s->frame_min_sp = cpu->sp;
+        if (cpu->sp < s->min_sp) {
+            s->min_sp = cpu->sp;
+            s->min_sp_pc = cpu->pc;
+        }
+    }
+}
+
+// Before interrupt(), which pushes pc outside of any instruction
+static inline void memstats_interrupt(memstats *s, const CPU *cpu) {
+    if (cpu->interrupts_disabled) return;
+    for (int i = 1; i <= 2; i++) {
+        const uint16_t addr = cpu->sp - i;
+        s->writes[addr >> 8]++;
+        s->written[addr >> 3] |= 1 << (addr & 7);
+    }
+    s->frame_writes += 2;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+#define FIRST_EXPORTED_BITS 10 // le="1.024e-06", the first exported bucket
+
+static volatile sig_atomic_t dump_requested;
+
+static void on_sigusr1(int sig) {
+    (void) sig;
+    dump_requested = 1;
+}
+
+static const struct {
+    const char *name;
+    const char *help;
+} counters[METRIC_COUNTERS] = {
+    [METRIC_INSTRUCTIONS] = { "emu_instructions_total", "Instructions retired by the interpreter" },
+    [METRIC_CYCLES] = { "emu_cycles_total", "Emulated clock states" },
+    [METRIC_FRAMES] = { "emu_frames_total", "Frames emulated" },
+    [METRIC_INTERRUPTS_TAKEN] = { "emu_interrupts_taken_total", "RST 1/2 taken" },
+    [METRIC_INTERRUPTS_DROPPED] = { "emu_interrupts_dropped_total", "RST 1/2 lost to interrupts being disabled" },
+    [METRIC_DEADLINE_MISSES] = { "emu_deadline_misses_total", "Frames that took longer than 1/60s" },
+};
+
+static const struct {
+    const char *name;
+    const char *help;
+} histograms[METRIC_HISTOGRAMS] = {
+    [METRIC_EMULATION] = { "emu_frame_emulation_seconds", "Time to emulate a frame" },
+    [METRIC_RENDER] = { "emu_frame_render_seconds", "Time to turn VRAM into the texture" },
+    [METRIC_PRESENT] = { "emu_frame_present_seconds", "Time to present a frame" },
+    [METRIC_SLEEP_OVERSHOOT] = { "emu_sleep_overshoot_seconds", "Time slept past the frame deadline" },
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+uint64_t metrics_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Exclusive upper end of a bucket, in ns
+static uint64_t bucket_end(const int b) {
+    if (b < METRIC_SUB) return b + 1;
+    const int e = b / METRIC_SUB + METRIC_SUB_BITS - 1;
+    const uint64_t m = b % METRIC_SUB;
+    return (METRIC_SUB + m + 1) << (e - METRIC_SUB_BITS);
+}
+
+static void write_histogram(const metric_hdr *hdr, const char *name, const char *help, FILE *f) {
+    uint64_t buckets[METRIC_BUCKETS];
+    uint64_t count = 0;
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+        buckets[b] = atomic_load_explicit(&hdr->buckets[b], memory_order_relaxed);
+        count += buckets[b];
+    }
+
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    uint64_t below = 0;
+    int b = 0;
+    for (int bits = FIRST_EXPORTED_BITS; bits <= METRIC_MAX_BITS; bits++) {
+        // every bucket under 2^bits ns
+        for (; b < (bits - METRIC_SUB_BITS + 1) * METRIC_SUB && b < METRIC_BUCKETS; b++) {
+            below += buckets[b];
+        }
+        fprintf(f, "%s_bucket{le=\"%.9g\"} %llu\n", name, (double) (1ULL << bits) / 1e9, (unsigned long long) below);
+    }
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) count);
+    fprintf(f, "%s_sum %.9f\n", name, atomic_load_explicit(&hdr->sum, memory_order_relaxed) / 1e9);
+    fprintf(f, "%s_count %llu\n", name, (unsigned long long) count);
+
+    fprintf(f, "# HELP %s_quantile %s, from the fine buckets\n# TYPE %s_quantile gauge\n", name, help, name);
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+        const uint64_t rank = (uint64_t) (quantiles[q] * count + 0.5);
+        uint64_t seen = 0, at = 0;
+        for (int i = 0; i < METRIC_BUCKETS && count; i++) {
+            seen += buckets[i];
+            if (seen >= rank && seen) {
+                at = bucket_end(i);
+                break;
+            }
+        }
+        fprintf(f, "%s_quantile{quantile=\"%g\"} %.9g\n", name, quantiles[q], at / 1e9);
+    }
+    fprintf(f, "# TYPE %s_max gauge\n%s_max %.9g\n", name, name,
+        atomic_load_explicit(&hdr->max, memory_order_relaxed) / 1e9);
+}
+
+void metrics_write(metrics *m, FILE *f) {
+    for (int c = 0; c < METRIC_COUNTERS; c++) {
+        fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counters[c].name, counters[c].help,
+            counters[c].name, counters[c].name,
+            (unsigned long long) atomic_load_explicit(&m->counters[c], memory_order_relaxed));
+    }
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++) {
+        write_histogram(&m->histograms[h], histograms[h].name, histograms[h].help, f);
+    }
+}
+
+static void dump(metrics *m) {
+    if (m->dump_path == NULL) {
+        metrics_write(m, stderr);
+        return;
+    }
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->dump_path);
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror("metrics dump");
+        return;
+    }
+    metrics_write(m, f);
+    if (fclose(f) != 0 || rename(tmp, m->dump_path) != 0) {
+        perror("metrics dump");
+    }
+}
+
+static void serve(metrics *m, const int fd) {
+    // a scraper says something first, nc doesn't have to
+    char request[1024];
+    ssize_t n = 0;
+    struct pollfd p = { .fd = fd, .events = POLLIN };
+    if (poll(&p, 1, 100) > 0) {
+        n = recv(fd, request, sizeof(request), 0);
+    }
+
+    FILE *f = fdopen(fd, "w");
+    if (f == NULL) {
+        close(fd);
+        return;
+    }
+    if (n >= 3 && memcmp(request, "GET", 3) == 0) {
+        fputs("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n", f);
+    }
+    metrics_write(m, f);
+    fclose(f);
+}
+
+static void* server(void *arg) {
+    metrics *m = arg;
+    while (!atomic_load(&m->quit)) {
+        struct pollfd p = { .fd = m->listen_fd, .events = POLLIN };
+        if (poll(&p, 1, 100) <= 0) continue;
+        const int fd = accept(m->listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            serve(m, fd);
+        }
+    }
+    return NULL;
+}
+
+metrics* metrics_open(const char *dump_path, const char *socket_path) {
+    metrics *m = calloc(1, sizeof(metrics));
+    m->dump_path = dump_path;
+    m->listen_fd = -1;
+
+    if (socket_path) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+            free(m);
+            return NULL;
+        }
+        strcpy(addr.sun_path, socket_path);
+        unlink(socket_path);
+
+        m->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m->listen_fd < 0 || bind(m->listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0
+                || listen(m->listen_fd, 4) != 0) {
+            perror("metrics socket");
+            if (m->listen_fd >= 0) close(m->listen_fd);
+            free(m);
+            return NULL;
+        }
+        m->socket_path = strdup(socket_path);
+        signal(SIGPIPE, SIG_IGN); // a scraper hanging up early
+        pthread_create(&m->server, NULL, server, m);
+    }
+
+    struct sigaction sa = { .sa_handler = on_sigusr1 };
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+    return m;
+}
+
+void metrics_poll(metrics *m) {
+    if (dump_requested) {
+        dump_requested = 0;
+        dump(m);
+    }
+}
+
+void metrics_close(metrics *m) {
+    signal(SIGUSR1, SIG_DFL);
+    if (m->dump_path) {
+        dump(m);
+    }
+    if (m->listen_fd >= 0) {
+        atomic_store(&m->quit, true);
+        pthread_join(m->server, NULL);
+        close(m->listen_fd);
+        unlink(m->socket_path);
+        free(m->socket_path);
+    }
+    free(m);
+}
@@ -0,0 +1,100 @@
+#ifndef metrics_h
+#define metrics_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// Runtime metrics in Prometheus text format. The frame loop bumps
+// counters and records durations with relaxed atomics, no locks, and
+// whoever reads them (the socket thread, a SIGUSR1 dump) sees a slightly
+// torn but never broken snapshot.
+//
+// Histograms are HDR style: 16 linear buckets per power of two of
+// nanoseconds, so any value lands in a bucket within 1/16 of it, from 1ns
+// to 2^40ns. They're exported with a bucket per power of two from 1us up,
+// plus p50/p90/p99/p999 from the fine buckets as gauges.
+//
+// The text goes to a file on SIGUSR1 and at exit (written next to it and
+// renamed, like node_exporter's textfile collector wants), and to every
+// client of the unix socket. A client that starts with "GET" gets an HTTP
+// response, curl --unix-socket works as well as nc -U.
+
+#define METRIC_SUB_BITS 4
+#define METRIC_SUB (1 << METRIC_SUB_BITS)
+#define METRIC_MAX_BITS 40
+#define METRIC_BUCKETS ((METRIC_MAX_BITS - METRIC_SUB_BITS + 1) * METRIC_SUB)
+
+typedef enum {
+    METRIC_INSTRUCTIONS,
+    METRIC_CYCLES,
+    METRIC_FRAMES,
+    METRIC_INTERRUPTS_TAKEN,
+    METRIC_INTERRUPTS_DROPPED, // interrupts were disabled when it came
+    METRIC_DEADLINE_MISSES, // frames that took longer than 1/60s
+    METRIC_COUNTERS
+} metric_counter;
+
+typedef enum {
+    METRIC_EMULATION, // running a frame's cycles
+    METRIC_RENDER, // VRAM to pixels and texture upload
+    METRIC_PRESENT, // SDL present
+    METRIC_SLEEP_OVERSHOOT, // slept longer than asked
+    METRIC_HISTOGRAMS
+} metric_histogram;
+
+typedef struct {
+    _Atomic uint64_t buckets[METRIC_BUCKETS];
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum; // ns
+    _Atomic uint64_t max;
+} metric_hdr;
+
+typedef struct {
+    _Atomic uint64_t counters[METRIC_COUNTERS];
+    metric_hdr histograms[METRIC_HISTOGRAMS];
+
+    const char *dump_path; // NULL = SIGUSR1 dumps to stderr
+    char *socket_path;
+    int listen_fd;
+    _Atomic bool quit;
+    pthread_t server;
+} metrics;
+
+// Either path may be NULL, NULL when the socket can't be set up
+metrics* metrics_open(const char *dump_path, const char *socket_path);
+// Dumps a last time when there's a dump path
+void metrics_close(metrics *m);
+
+// Once per frame, writes the dump if SIGUSR1 came in since
+void metrics_poll(metrics *m);
+
+void metrics_write(metrics *m, FILE *f);
+
+uint64_t metrics_now();
+
+static inline void metrics_add(metrics *m, const metric_counter c, const uint64_t n) {
+    atomic_fetch_add_explicit(&m->counters[c], n, memory_order_relaxed);
+}
+
+static inline int metrics_bucket(uint64_t ns) {
+    if (ns >> METRIC_MAX_BITS) ns = (1ULL << METRIC_MAX_BITS) - 1;
+    if (ns < METRIC_SUB) return ns;
+    const int e = 63 - __builtin_clzll(ns);
+    return (e - METRIC_SUB_BITS + 1) * METRIC_SUB + ((ns >> (e - METRIC_SUB_BITS)) & (METRIC_SUB - 1));
+}
+
+static inline void metrics_record(metrics *m, const metric_histogram h, const uint64_t ns) {
+    metric_hdr *hdr = &m->histograms[h];
+    atomic_fetch_add_explicit(&hdr->buckets[metrics_bucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hdr->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hdr->sum, ns, memory_order_relaxed);
+    uint64_t max = atomic_load_explicit(&hdr->max, memory_order_relaxed);
+    while (ns > max && !atomic_compare_exchange_weak_explicit(&hdr->max, &max, ns,
+            memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+#endif
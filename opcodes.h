@@ -0,0 +1,332 @@
+#ifndef opcodes_h
+#define opcodes_h
+
+#include <stdint.h>
+
+// Everything about an opcode but what it does, in one table: the
+// interpreter charges its clock states from it, the disassembler prints
+// its mnemonic and the block walk follows its control flow, both of them
+// stepping by its length. The interpreter's opcode bodies move pc by hand,
+// the opcode_table test holds them to the same lengths. The flags columns say what an instruction
+// reads and what it overwrites: a flag written again before anything
+// reads it is dead, and an instruction whose flags are all dead needn't
+// compute them.
+//
+// It's static const, a constant opcode (exec_op() in emu-recomp's output)
+// folds the lookups away. -DCPU_8085 builds get the 8085's clock states
+// and RIM/SIM, see cpu.h.
+
+// Bits of the flags byte, see flags in cpu.h
+#define F_CARRY  0x01
+#define F_PARITY 0x04
+#define F_AUX    0x10
+#define F_ZERO   0x40
+#define F_SIGN   0x80
+#define F_ALL    (F_CARRY | F_PARITY | F_AUX | F_ZERO | F_SIGN)
+
+typedef enum {
+    FLOW_NEXT, // falls through to pc + length
+    FLOW_JUMP, // JMP: the target
+    FLOW_JUMP_COND, // Jcc: the target or the next instruction
+    FLOW_CALL, // CALL: the target, returns to the next instruction
+    FLOW_CALL_COND, // Ccc
+    FLOW_RET, // RET: wherever the stack says
+    FLOW_RET_COND, // Rcc: the stack or the next instruction
+    FLOW_RST, // RST n: a call to n * 8
+    FLOW_INDIRECT, // PCHL: HL, nothing to follow statically
+    FLOW_HALT, // HLT
+    FLOW_INVALID, // not an instruction of this CPU, exec_op() stops on it
+} op_flow;
+
+typedef struct {
+    const char *mnemonic; // printf format, its one conversion (if any) takes the operand
+    uint8_t length; // bytes, opcode included
+    uint8_t cycles; // clock states, the not-taken cost of a conditional branch
+    uint8_t taken; // states a taken conditional branch adds
+    uint8_t flags_read; // F_* bits
+    uint8_t flags_written;
+    uint8_t flow; // op_flow
+} op_info;
+
+#ifdef CPU_8085
+#define CLK(i8080, i8085) (i8085)
+#define JUMP_TAKEN 3
+#define CALL_TAKEN 9
+#define RET_TAKEN 6
+#else
+#define CLK(i8080, i8085) (i8080)
+#define JUMP_TAKEN 0
+#define CALL_TAKEN 6
+#define RET_TAKEN 6
+#endif
+
+static const op_info opcodes[256] = {
+    [0x00] = { "NOP", 1, 4, 0, 0, 0, FLOW_NEXT },
+    [0x01] = { "LXI B, $#%04x", 3, 10, 0, 0, 0, FLOW_NEXT },
+    [0x02] = { "STAX B", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x03] = { "INX B", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x04] = { "INR B", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x05] = { "DCR B", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x06] = { "MVI B, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x07] = { "RLC", 1, 4, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x08] = { "???", 1, CLK(4, 10), 0, 0, 0, FLOW_INVALID },
+    [0x09] = { "DAD B", 1, 10, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x0a] = { "LDAX B", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x0b] = { "DCX B", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x0c] = { "INR C", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x0d] = { "DCR C", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x0e] = { "MVI C, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x0f] = { "RRC", 1, 4, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x10] = { "???", 1, CLK(4, 7), 0, 0, 0, FLOW_INVALID },
+    [0x11] = { "LXI D, $#%04x", 3, 10, 0, 0, 0, FLOW_NEXT },
+    [0x12] = { "STAX D", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x13] = { "INX D", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x14] = { "INR D", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x15] = { "DCR D", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x16] = { "MVI D, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x17] = { "RAL", 1, 4, 0, F_CARRY, F_CARRY, FLOW_NEXT },
+    [0x18] = { "???", 1, CLK(4, 10), 0, 0, 0, FLOW_INVALID },
+    [0x19] = { "DAD D", 1, 10, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x1a] = { "LDAX D", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x1b] = { "DCX D", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x1c] = { "INR E", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x1d] = { "DCR E", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x1e] = { "MVI E, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x1f] = { "RAR", 1, 4, 0, F_CARRY, F_CARRY, FLOW_NEXT },
+#ifdef CPU_8085
+    [0x20] = { "RIM", 1, 4, 0, 0, 0, FLOW_NEXT },
+#else
+    [0x20] = { "???", 1, 4, 0, 0, 0, FLOW_INVALID },
+#endif
+    [0x21] = { "LXI H, $#%04x", 3, 10, 0, 0, 0, FLOW_NEXT },
+    [0x22] = { "SHLD $%04x", 3, 16, 0, 0, 0, FLOW_NEXT },
+    [0x23] = { "INX H", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x24] = { "INR H", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x25] = { "DCR H", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x26] = { "MVI H, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x27] = { "DAA", 1, 4, 0, F_AUX | F_CARRY, F_ALL, FLOW_NEXT },
+    [0x28] = { "???", 1, CLK(4, 10), 0, 0, 0, FLOW_INVALID },
+    [0x29] = { "DAD H", 1, 10, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x2a] = { "LHLD $%04x", 3, 16, 0, 0, 0, FLOW_NEXT },
+    [0x2b] = { "DCX H", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x2c] = { "INR L", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x2d] = { "DCR L", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x2e] = { "MVI L, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x2f] = { "CMA", 1, 4, 0, 0, 0, FLOW_NEXT },
+#ifdef CPU_8085
+    [0x30] = { "SIM", 1, 4, 0, 0, 0, FLOW_NEXT },
+#else
+    [0x30] = { "???", 1, 4, 0, 0, 0, FLOW_INVALID },
+#endif
+    [0x31] = { "LXI SP, $#%04x", 3, 10, 0, 0, 0, FLOW_NEXT },
+    [0x32] = { "STA $%04x", 3, 13, 0, 0, 0, FLOW_NEXT },
+    [0x33] = { "INX SP", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x34] = { "INR M", 1, 10, 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x35] = { "DCR M", 1, 10, 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x36] = { "MVI M, $#%02x", 2, 10, 0, 0, 0, FLOW_NEXT },
+    [0x37] = { "STC", 1, 4, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x38] = { "???", 1, CLK(4, 10), 0, 0, 0, FLOW_INVALID },
+    [0x39] = { "DAD SP", 1, 10, 0, 0, F_CARRY, FLOW_NEXT },
+    [0x3a] = { "LDA $%04x", 3, 13, 0, 0, 0, FLOW_NEXT },
+    [0x3b] = { "DCX SP", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0x3c] = { "INR A", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x3d] = { "DCR A", 1, CLK(5, 4), 0, 0, F_SIGN | F_ZERO | F_AUX | F_PARITY, FLOW_NEXT },
+    [0x3e] = { "MVI A, $#%02x", 2, 7, 0, 0, 0, FLOW_NEXT },
+    [0x3f] = { "CMC", 1, 4, 0, F_CARRY, F_CARRY, FLOW_NEXT },
+    [0x40] = { "MOV B,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x41] = { "MOV B,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x42] = { "MOV B,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x43] = { "MOV B,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x44] = { "MOV B,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x45] = { "MOV B,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x46] = { "MOV B,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x47] = { "MOV B,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x48] = { "MOV C,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x49] = { "MOV C,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x4a] = { "MOV C,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x4b] = { "MOV C,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x4c] = { "MOV C,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x4d] = { "MOV C,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x4e] = { "MOV C,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x4f] = { "MOV C,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x50] = { "MOV D,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x51] = { "MOV D,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x52] = { "MOV D,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x53] = { "MOV D,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x54] = { "MOV D,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x55] = { "MOV D,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x56] = { "MOV D,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x57] = { "MOV D,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x58] = { "MOV E,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x59] = { "MOV E,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x5a] = { "MOV E,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x5b] = { "MOV E,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x5c] = { "MOV E,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x5d] = { "MOV E,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x5e] = { "MOV E,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x5f] = { "MOV E,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x60] = { "MOV H,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x61] = { "MOV H,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x62] = { "MOV H,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x63] = { "MOV H,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x64] = { "MOV H,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x65] = { "MOV H,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x66] = { "MOV H,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x67] = { "MOV H,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x68] = { "MOV L,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x69] = { "MOV L,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x6a] = { "MOV L,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x6b] = { "MOV L,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x6c] = { "MOV L,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x6d] = { "MOV L,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x6e] = { "MOV L,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x6f] = { "MOV L,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x70] = { "MOV M,B", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x71] = { "MOV M,C", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x72] = { "MOV M,D", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x73] = { "MOV M,E", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x74] = { "MOV M,H", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x75] = { "MOV M,L", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x76] = { "HLT", 1, CLK(7, 5), 0, 0, 0, FLOW_HALT },
+    [0x77] = { "MOV M,A", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x78] = { "MOV A,B", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x79] = { "MOV A,C", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x7a] = { "MOV A,D", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x7b] = { "MOV A,E", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x7c] = { "MOV A,H", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x7d] = { "MOV A,L", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x7e] = { "MOV A,M", 1, 7, 0, 0, 0, FLOW_NEXT },
+    [0x7f] = { "MOV A,A", 1, CLK(5, 4), 0, 0, 0, FLOW_NEXT },
+    [0x80] = { "ADD B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x81] = { "ADD C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x82] = { "ADD D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x83] = { "ADD E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x84] = { "ADD H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x85] = { "ADD L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x86] = { "ADD M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0x87] = { "ADD A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x88] = { "ADC B", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x89] = { "ADC C", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8a] = { "ADC D", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8b] = { "ADC E", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8c] = { "ADC H", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8d] = { "ADC L", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8e] = { "ADC M", 1, 7, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x8f] = { "ADC A", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x90] = { "SUB B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x91] = { "SUB C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x92] = { "SUB D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x93] = { "SUB E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x94] = { "SUB H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x95] = { "SUB L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x96] = { "SUB M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0x97] = { "SUB A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0x98] = { "SBB B", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x99] = { "SBB C", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9a] = { "SBB D", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9b] = { "SBB E", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9c] = { "SBB H", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9d] = { "SBB L", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9e] = { "SBB M", 1, 7, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0x9f] = { "SBB A", 1, 4, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0xa0] = { "ANA B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa1] = { "ANA C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa2] = { "ANA D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa3] = { "ANA E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa4] = { "ANA H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa5] = { "ANA L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa6] = { "ANA M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa7] = { "ANA A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa8] = { "XRA B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xa9] = { "XRA C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xaa] = { "XRA D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xab] = { "XRA E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xac] = { "XRA H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xad] = { "XRA L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xae] = { "XRA M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xaf] = { "XRA A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb0] = { "ORA B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb1] = { "ORA C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb2] = { "ORA D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb3] = { "ORA E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb4] = { "ORA H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb5] = { "ORA L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb6] = { "ORA M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb7] = { "ORA A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb8] = { "CMP B", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xb9] = { "CMP C", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xba] = { "CMP D", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xbb] = { "CMP E", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xbc] = { "CMP H", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xbd] = { "CMP L", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xbe] = { "CMP M", 1, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xbf] = { "CMP A", 1, 4, 0, 0, F_ALL, FLOW_NEXT },
+    [0xc0] = { "RNZ", 1, CLK(5, 6), RET_TAKEN, F_ZERO, 0, FLOW_RET_COND },
+    [0xc1] = { "POP B", 1, 10, 0, 0, 0, FLOW_NEXT },
+    [0xc2] = { "JNZ $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_ZERO, 0, FLOW_JUMP_COND },
+    [0xc3] = { "JMP $%04x", 3, 10, 0, 0, 0, FLOW_JUMP },
+    [0xc4] = { "CNZ $%04x", 3, CLK(11, 9), CALL_TAKEN, F_ZERO, 0, FLOW_CALL_COND },
+    [0xc5] = { "PUSH B", 1, CLK(11, 12), 0, 0, 0, FLOW_NEXT },
+    [0xc6] = { "ADI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xc7] = { "RST 0", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xc8] = { "RZ", 1, CLK(5, 6), RET_TAKEN, F_ZERO, 0, FLOW_RET_COND },
+    [0xc9] = { "RET", 1, 10, 0, 0, 0, FLOW_RET },
+    [0xca] = { "JZ $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_ZERO, 0, FLOW_JUMP_COND },
+    [0xcb] = { "???", 1, CLK(10, 6), 0, 0, 0, FLOW_INVALID },
+    [0xcc] = { "CZ $%04x", 3, CLK(11, 9), CALL_TAKEN, F_ZERO, 0, FLOW_CALL_COND },
+    [0xcd] = { "CALL $%04x", 3, CLK(17, 18), 0, 0, 0, FLOW_CALL },
+    [0xce] = { "ACI $#%02x", 2, 7, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0xcf] = { "RST 1", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xd0] = { "RNC", 1, CLK(5, 6), RET_TAKEN, F_CARRY, 0, FLOW_RET_COND },
+    [0xd1] = { "POP D", 1, 10, 0, 0, 0, FLOW_NEXT },
+    [0xd2] = { "JNC $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_CARRY, 0, FLOW_JUMP_COND },
+    [0xd3] = { "OUT $%02x", 2, 10, 0, 0, 0, FLOW_NEXT },
+    [0xd4] = { "CNC $%04x", 3, CLK(11, 9), CALL_TAKEN, F_CARRY, 0, FLOW_CALL_COND },
+    [0xd5] = { "PUSH D", 1, CLK(11, 12), 0, 0, 0, FLOW_NEXT },
+    [0xd6] = { "SUI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xd7] = { "RST 2", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xd8] = { "RC", 1, CLK(5, 6), RET_TAKEN, F_CARRY, 0, FLOW_RET_COND },
+    [0xd9] = { "???", 1, 10, 0, 0, 0, FLOW_INVALID },
+    [0xda] = { "JC $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_CARRY, 0, FLOW_JUMP_COND },
+    [0xdb] = { "IN $%02x", 2, 10, 0, 0, 0, FLOW_NEXT },
+    [0xdc] = { "CC $%04x", 3, CLK(11, 9), CALL_TAKEN, F_CARRY, 0, FLOW_CALL_COND },
+    [0xdd] = { "???", 1, CLK(17, 7), 0, 0, 0, FLOW_INVALID },
+    [0xde] = { "SBI $#%02x", 2, 7, 0, F_CARRY, F_ALL, FLOW_NEXT },
+    [0xdf] = { "RST 3", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xe0] = { "RPO", 1, CLK(5, 6), RET_TAKEN, F_PARITY, 0, FLOW_RET_COND },
+    [0xe1] = { "POP H", 1, 10, 0, 0, 0, FLOW_NEXT },
+    [0xe2] = { "JPO $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_PARITY, 0, FLOW_JUMP_COND },
+    [0xe3] = { "XTHL", 1, CLK(18, 16), 0, 0, 0, FLOW_NEXT },
+    [0xe4] = { "CPO $%04x", 3, CLK(11, 9), CALL_TAKEN, F_PARITY, 0, FLOW_CALL_COND },
+    [0xe5] = { "PUSH H", 1, CLK(11, 12), 0, 0, 0, FLOW_NEXT },
+    [0xe6] = { "ANI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xe7] = { "RST 4", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xe8] = { "RPE", 1, CLK(5, 6), RET_TAKEN, F_PARITY, 0, FLOW_RET_COND },
+    [0xe9] = { "PCHL", 1, CLK(5, 6), 0, 0, 0, FLOW_INDIRECT },
+    [0xea] = { "JPE $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_PARITY, 0, FLOW_JUMP_COND },
+    [0xeb] = { "XCHG", 1, 4, 0, 0, 0, FLOW_NEXT },
+    [0xec] = { "CPE $%04x", 3, CLK(11, 9), CALL_TAKEN, F_PARITY, 0, FLOW_CALL_COND },
+    [0xed] = { "???", 1, CLK(17, 10), 0, 0, 0, FLOW_INVALID },
+    [0xee] = { "XRI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xef] = { "RST 5", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xf0] = { "RP", 1, CLK(5, 6), RET_TAKEN, F_SIGN, 0, FLOW_RET_COND },
+    [0xf1] = { "POP PSW", 1, 10, 0, 0, F_ALL, FLOW_NEXT },
+    [0xf2] = { "JP $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_SIGN, 0, FLOW_JUMP_COND },
+    [0xf3] = { "DI", 1, 4, 0, 0, 0, FLOW_NEXT },
+    [0xf4] = { "CP $%04x", 3, CLK(11, 9), CALL_TAKEN, F_SIGN, 0, FLOW_CALL_COND },
+    [0xf5] = { "PUSH PSW", 1, CLK(11, 12), 0, F_ALL, 0, FLOW_NEXT },
+    [0xf6] = { "ORI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xf7] = { "RST 6", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+    [0xf8] = { "RM", 1, CLK(5, 6), RET_TAKEN, F_SIGN, 0, FLOW_RET_COND },
+    [0xf9] = { "SPHL", 1, CLK(5, 6), 0, 0, 0, FLOW_NEXT },
+    [0xfa] = { "JM $%04x", 3, CLK(10, 7), JUMP_TAKEN, F_SIGN, 0, FLOW_JUMP_COND },
+    [0xfb] = { "EI", 1, 4, 0, 0, 0, FLOW_NEXT },
+    [0xfc] = { "CM $%04x", 3, CLK(11, 9), CALL_TAKEN, F_SIGN, 0, FLOW_CALL_COND },
+    [0xfd] = { "???", 1, CLK(17, 7), 0, 0, 0, FLOW_INVALID },
+    [0xfe] = { "CPI $#%02x", 2, 7, 0, 0, F_ALL, FLOW_NEXT },
+    [0xff] = { "RST 7", 1, CLK(11, 12), 0, 0, 0, FLOW_RST },
+};
+
+#undef CLK
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "rom.h"
+
+typedef struct {
+    const char *name;
+    uint32_t crc32; // of the parts one after the other, a merged single file
+    rom_part parts[8];
+} rom_set;
+
+// Same layout and CRCs as MAME's sets.
+static const rom_set sets[] = {
+    { "invaders", 0xb64ca815, {
+        { "invaders.h", 0x0000, 0x0800, 0x734f5ad8 },
+        { "invaders.g", 0x0800, 0x0800, 0x6bfaca4a },
+        { "invaders.f", 0x1000, 0x0800, 0x0ccead96 },
+        { "invaders.e", 0x1800, 0x0800, 0x14e538b0 },
+    } },
+};
+#define NUM_SETS (sizeof(sets) / sizeof(sets[0]))
+
+uint32_t crc32(const uint8_t *buf, size_t size) {
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= buf[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static size_t page_round(size_t size) {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+static rom_image* map_image(int fd, size_t size, uint16_t base_addr) {
+    if (size == 0 || base_addr + size > MEM_SIZE) {
+        printf("rom: %zu bytes don't fit at 0x%04x\n", size, base_addr);
+        return NULL;
+    }
+
+    const size_t map_size = page_round(size);
+    uint8_t *data = mmap(NULL, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("rom mmap");
+        return NULL;
+    }
+
+    rom_image *rom = calloc(sizeof(rom_image), 1);
+    if (rom == NULL) {
+        munmap(data, map_size);
+        return NULL;
+    }
+    rom->data = data;
+    rom->size = size;
+    rom->map_size = map_size;
+    rom->base_addr = base_addr;
+    rom->fd = fd;
+    rom->crc32 = crc32(data, size);
+    return rom;
+}
+
+static size_t set_size(const rom_set *set) {
+    size_t size = 0;
+    for (const rom_part *part = set->parts; part->file; part++) {
+        if (part->offset + part->size > size) size = part->offset + part->size;
+    }
+    return size;
+}
+
+// Reads every part of the set into one page aligned, unlinked file.
+static rom_image* open_set(const rom_set *set, const char *dir, uint16_t base_addr) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("rom mkstemp");
+        return NULL;
+    }
+    unlink(path);
+
+    const size_t size = set_size(set);
+    if (ftruncate(fd, page_round(size)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    for (const rom_part *part = set->parts; part->file; part++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, part->file);
+        const int part_fd = open(path, O_RDONLY);
+        struct stat st;
+        if (part_fd < 0 || fstat(part_fd, &st) != 0 || st.st_size != part->size) {
+            printf("rom: %s missing or not %u bytes\n", path, part->size);
+            if (part_fd >= 0) close(part_fd);
+            close(fd);
+            return NULL;
+        }
+
+        uint8_t *buf = mmap(NULL, part->size, PROT_READ, MAP_PRIVATE, part_fd, 0);
+        close(part_fd);
+        if (buf == MAP_FAILED) {
+            close(fd);
+            return NULL;
+        }
+
+        const uint32_t crc = crc32(buf, part->size);
+        const bool ok = crc == part->crc32 && pwrite(fd, buf, part->size, part->offset) == part->size;
+        munmap(buf, part->size);
+        if (!ok) {
+            printf("rom: %s crc32 %08x, expected %08x\n", path, crc, part->crc32);
+            close(fd);
+            return NULL;
+        }
+    }
+
+    rom_image *rom = map_image(fd, size, base_addr);
+    if (rom == NULL) {
+        close(fd);
+        return NULL;
+    }
+    rom->set = set->name;
+    return rom;
+}
+
+rom_image* rom_open(const char *path, uint16_t base_addr) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return NULL;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        // first set with all its files in the directory
+        for (size_t i = 0; i < NUM_SETS; i++) {
+            char first[1024];
+            snprintf(first, sizeof(first), "%s/%s", path, sets[i].parts[0].file);
+            if (access(first, R_OK) == 0) {
+                return open_set(&sets[i], path, base_addr);
+            }
+        }
+        printf("rom: no known rom set in %s\n", path);
+        return NULL;
+    }
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    rom_image *rom = map_image(fd, st.st_size, base_addr);
+    if (rom == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    // A single file can be any program (the diag roms, test code), only one
+    // the size of a known set is checked against that set merged. It still
+    // loads when it doesn't match, there are revisions and hacks of those.
+    for (size_t i = 0; i < NUM_SETS; i++) {
+        if (rom->size != set_size(&sets[i])) continue;
+        if (rom->crc32 == sets[i].crc32) {
+            rom->set = sets[i].name;
+            break;
+        }
+        printf("rom: %s is the size of the %s set but crc32 %08x, expected %08x\n", path, sets[i].name,
+            rom->crc32, sets[i].crc32);
+    }
+    return rom;
+}
+
+void rom_load(CPU* cpu, const rom_image *rom) {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    uint8_t *dst = &cpu->mem[rom->base_addr];
+
+    // Whole pages are mapped copy on write, they stay shared until the
+    // guest writes to them. Whatever doesn't line up with a page is copied.
+    size_t mapped = 0;
+    if ((uintptr_t) dst % page == 0) {
+        mapped = rom->size / page * page;
+        if (mapped > 0 && mmap(dst, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, rom->fd, 0) == MAP_FAILED) {
+            mapped = 0;
+        }
+    }
+    memcpy(dst + mapped, rom->data + mapped, rom->size - mapped);
+}
+
+void rom_close(rom_image *rom) {
+    munmap(rom->data, rom->map_size);
+    close(rom->fd);
+    free(rom);
+}
@@ -0,0 +1,39 @@
+#ifndef rom_h
+#define rom_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+
+// ROM images are mmap'ed, never copied onto the stack or the heap. A path
+// can be a single image file or a directory holding a known split rom set
+// (e.g. invaders.h/g/f/e), which gets CRC32 checked and assembled once into
+// an unlinked temp file. A single file the size of a known set is checked
+// against the set's merged CRC32. rom_load() maps the image's whole pages
+// straight into a machine's memory (copy on write), so any number of
+// machines share the same physical ROM pages.
+
+typedef struct {
+    const char *file;
+    uint16_t offset; // from the set's base address
+    uint16_t size;
+    uint32_t crc32;
+} rom_part;
+
+typedef struct {
+    uint8_t *data; // read only, size bytes
+    size_t size;
+    size_t map_size;
+    uint16_t base_addr;
+    int fd; // backing file, mapped into every machine
+    uint32_t crc32; // of the whole image
+    const char *set; // the known set it is, split or merged into one file, NULL for anything else
+} rom_image;
+
+uint32_t crc32(const uint8_t *buf, size_t size);
+
+rom_image* rom_open(const char *path, uint16_t base_addr);
+void rom_load(CPU* cpu, const rom_image *rom);
+void rom_close(rom_image *rom);
+
+#endif
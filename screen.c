@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+
+static const uint32_t gels[SCREEN_COLORS] = {
+    [SCREEN_WHITE] = 0xffffffff,
+    [SCREEN_RED] = 0xffff2020,
+    [SCREEN_GREEN] = 0xff20ff20,
+};
+
+// Transposes an 8x8 bit matrix, byte r bit c to byte c bit r
+static inline uint64_t transpose8(uint64_t x) {
+    uint64_t t;
+    t = (x ^ (x >> 7)) & 0x00aa00aa00aa00aaULL;
+    x ^= t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000cccc0000ccccULL;
+    x ^= t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000f0f0f0f0ULL;
+    x ^= t ^ (t << 28);
+    return x;
+}
+
+// VRAM is the rotated screen: byte x * 32 + v / 8 holds 8 pixels of
+// column x from the bottom up, bit 0 first. The same VRAM byte of 8
+// neighbouring columns is an 8x8 block, transposed it's 8 screen rows.
+void screen_rows(const uint8_t *vram, uint8_t *rows) {
+    for (int x = 0; x < SCREEN_WIDTH; x += 8) {
+        for (int b = 0; b < SCREEN_HEIGHT / 8; b++) {
+            uint64_t block = 0;
+            for (int k = 0; k < 8; k++) {
+                block |= (uint64_t) vram[(x + k) * (SCREEN_HEIGHT / 8) + b] << (8 * (7 - k));
+            }
+            block = transpose8(block);
+            for (int j = 0; j < 8; j++) {
+                rows[(SCREEN_HEIGHT - 1 - b * 8 - j) * SCREEN_ROW_BYTES + x / 8] = block >> (8 * j);
+            }
+        }
+    }
+}
+
+static uint8_t gel(const int y, const int x) {
+    if (y >= 32 && y < 64) return SCREEN_RED;
+    if (y >= 184 && y < 240) return SCREEN_GREEN;
+    if (y >= 240 && x >= 16 && x < 136) return SCREEN_GREEN;
+    return SCREEN_WHITE;
+}
+
+screen* screen_open(int scale, bool overlay) {
+    screen *s = calloc(1, sizeof(screen));
+    s->scale = scale;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        for (int c = 0; c < SCREEN_ROW_BYTES; c++) {
+            s->color[y][c] = overlay ? gel(y, c * 8) : SCREEN_WHITE;
+        }
+    }
+
+    const int width = 8 * scale;
+    s->lut = malloc(SCREEN_COLORS * 256 * width * sizeof(uint32_t));
+    for (int color = 0; color < SCREEN_COLORS; color++) {
+        for (int v = 0; v < 256; v++) {
+            uint32_t *px = &s->lut[(color * 256 + v) * width];
+            for (int k = 0; k < width; k++) {
+                px[k] = v & (0x80 >> (k / scale)) ? gels[color] : 0xff000000;
+            }
+        }
+    }
+    return s;
+}
+
+void screen_close(screen *s) {
+    free(s->lut);
+    free(s);
+}
+
+// One screen row, width pixels a byte. A constant width lets memcpy
+// inline into a couple of vector moves.
+static inline void render_row(const screen *s, const int y, const uint8_t *row, uint32_t *out, const int width) {
+    for (int c = 0; c < SCREEN_ROW_BYTES; c++) {
+        memcpy(&out[c * width], &s->lut[(s->color[y][c] * 256 + row[c]) * width], width * sizeof(uint32_t));
+    }
+}
+
+void screen_render(const screen *s, const uint8_t *vram, uint32_t *pixels) {
+    uint8_t rows[SCREEN_ROW_BYTES * SCREEN_HEIGHT];
+    screen_rows(vram, rows);
+
+    const int pitch = SCREEN_WIDTH * s->scale;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *out = &pixels[y * s->scale * pitch];
+        const uint8_t *row = &rows[y * SCREEN_ROW_BYTES];
+        switch (s->scale) {
+            case 1: render_row(s, y, row, out, 8); break;
+            case 2: render_row(s, y, row, out, 16); break;
+            default: render_row(s, y, row, out, 8 * s->scale); break;
+        }
+        for (int k = 1; k < s->scale; k++) {
+            memcpy(&out[k * pitch], out, pitch * sizeof(uint32_t));
+        }
+    }
+}
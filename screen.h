@@ -0,0 +1,41 @@
+#ifndef screen_h
+#define screen_h
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// VRAM to ARGB8888 pixels for the SDL frontend, with the cabinet's gel
+// overlay and integer scaling done on the CPU. VRAM is turned upright 8x8
+// blocks at a time, then every byte of a screen row is looked up as its
+// 8 pixels (8 * scale wide) in the row's gel color, no per pixel branch.
+// Scaled rows are copies of the first.
+//
+// The overlay is the usual upright cabinet's: red across the UFO band,
+// green over the shields and the player, and over the reserve ships left
+// of the credits on the bottom line, white elsewhere. Its edges are kept
+// on 8 pixel columns so a LUT entry is one color.
+
+#define SCREEN_WIDTH 224
+#define SCREEN_HEIGHT 256
+#define SCREEN_ROW_BYTES (SCREEN_WIDTH / 8)
+#define SCREEN_VRAM 0x2400
+#define SCREEN_VRAM_SIZE 0x1c00
+
+enum { SCREEN_WHITE, SCREEN_RED, SCREEN_GREEN, SCREEN_COLORS };
+
+typedef struct {
+    int scale;
+    uint8_t color[SCREEN_HEIGHT][SCREEN_ROW_BYTES]; // gel of every 8 pixels
+    uint32_t *lut; // [SCREEN_COLORS][256][8 * scale]
+} screen;
+
+// The upright screen, 1 bit per pixel, MSB first, SCREEN_ROW_BYTES a row
+void screen_rows(const uint8_t *vram, uint8_t *rows);
+
+screen* screen_open(int scale, bool overlay);
+void screen_close(screen *s);
+
+// pixels is (SCREEN_WIDTH * scale) x (SCREEN_HEIGHT * scale)
+void screen_render(const screen *s, const uint8_t *vram, uint32_t *pixels);
+
+#endif
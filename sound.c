@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sound.h"
+
+#define CYCLES_PER_SAMPLE ((double) SOUND_CPU_HZ / SOUND_SAMPLE_RATE)
+#define UFO 0 // the only looping sound
+
+// Stand-ins for missing sample files: a tone sweeping from freq to
+// freq_end, or noise, with a linear fade out.
+typedef struct {
+    float seconds;
+    float freq;
+    float freq_end;
+    bool noise;
+} synth;
+
+static const synth synths[SOUND_NUM_SAMPLES] = {
+    { 0.2f,  700, 1100, false }, // 0 UFO
+    { 0.3f,    0,    0, true  }, // 1 shot
+    { 1.0f,    0,    0, true  }, // 2 player dies
+    { 0.3f,    0,    0, true  }, // 3 invader dies
+    { 0.1f,  110,  110, false }, // 4 fleet 1
+    { 0.1f,  100,  100, false }, // 5 fleet 2
+    { 0.1f,   90,   90, false }, // 6 fleet 3
+    { 0.1f,   80,   80, false }, // 7 fleet 4
+    { 1.0f, 1200,  300, false }, // 8 UFO hit
+    { 1.0f,  880,  880, false }, // 9 extended play
+};
+
+static bool synthesize(sound_sample *sample, const synth *syn) {
+    sample->len = syn->seconds * SOUND_SAMPLE_RATE;
+    sample->data = malloc(sample->len * sizeof(int16_t));
+    if (sample->data == NULL) {
+        sample->len = 0;
+        return false;
+    }
+
+    uint32_t rnd = 0x1234567;
+    double phase = 0;
+    for (uint32_t i = 0; i < sample->len; i++) {
+        const double t = (double) i / sample->len;
+        const double fade = syn->freq == syn->freq_end || syn->noise ? 1.0 - t : 1.0;
+        double v;
+        if (syn->noise) {
+            rnd = rnd * 1103515245 + 12345;
+            v = ((rnd >> 16) & 0x7fff) / 16384.0 - 1.0;
+        } else {
+            phase += (syn->freq + (syn->freq_end - syn->freq) * t) / SOUND_SAMPLE_RATE;
+            v = phase - floor(phase) < 0.5 ? 1.0 : -1.0;
+        }
+        sample->data[i] = v * fade * 8000;
+    }
+    return true;
+}
+
+static uint32_t le32(const uint8_t *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24); }
+static uint16_t le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+// 8 or 16 bit PCM, any rate/channel count, ends up as mono at our rate.
+static bool load_wav(sound_sample *sample, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return false;
+    }
+    fseek(f, 0L, SEEK_END);
+    const long size = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    uint8_t *buf = size > 0 ? malloc(size) : NULL;
+    if (buf == NULL) {
+        fclose(f);
+        return false;
+    }
+    const bool read = fread(buf, size, 1, f) == 1;
+    fclose(f);
+
+    if (!read || size < 12 || memcmp(buf, "RIFF", 4) != 0 || memcmp(buf + 8, "WAVE", 4) != 0) {
+        free(buf);
+        return false;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    const uint8_t *data = NULL;
+    uint32_t data_len = 0;
+    for (long pos = 12; pos + 8 <= size; ) {
+        const uint32_t len = le32(buf + pos + 4);
+        const uint8_t *chunk = buf + pos + 8;
+        if (pos + 8 + (long) len > size) break;
+
+        if (memcmp(buf + pos, "fmt ", 4) == 0 && len >= 16) {
+            format = le16(chunk);
+            channels = le16(chunk + 2);
+            rate = le32(chunk + 4);
+            bits = le16(chunk + 14);
+        } else if (memcmp(buf + pos, "data", 4) == 0) {
+            data = chunk;
+            data_len = len;
+        }
+        pos += 8 + len + (len & 1);
+    }
+
+    if (format != 1 || channels == 0 || rate == 0 || (bits != 8 && bits != 16) || data == NULL) {
+        free(buf);
+        return false;
+    }
+
+    const uint32_t frame_size = channels * bits / 8;
+    const uint32_t frames = data_len / frame_size;
+    if (frames == 0) {
+        free(buf);
+        return false;
+    }
+    sample->len = (uint64_t) frames * SOUND_SAMPLE_RATE / rate;
+    sample->data = malloc(sample->len * sizeof(int16_t));
+    if (sample->data == NULL) {
+        sample->len = 0;
+        free(buf);
+        return false;
+    }
+    for (uint32_t i = 0; i < sample->len; i++) {
+        // nearest neighbour is plenty for these
+        const uint8_t *frame = data + (uint64_t) i * rate / SOUND_SAMPLE_RATE * frame_size;
+        int32_t sum = 0;
+        for (int c = 0; c < channels; c++) {
+            sum += bits == 8 ? (frame[c] - 128) << 8 : (int16_t) le16(frame + c * 2);
+        }
+        sample->data[i] = sum / channels;
+    }
+
+    free(buf);
+    return true;
+}
+
+sound* sound_init(const char *sample_dir) {
+    sound *s = calloc(sizeof(sound), 1);
+    if (s == NULL) {
+        return NULL;
+    }
+    for (int i = 0; i < SOUND_NUM_SAMPLES; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%d.wav", sample_dir ? sample_dir : ".", i);
+        if ((sample_dir == NULL || !load_wav(&s->samples[i], path)) && !synthesize(&s->samples[i], &synths[i])) {
+            sound_free(s);
+            return NULL;
+        }
+    }
+    s->voices[UFO].loop = true;
+    return s;
+}
+
+void sound_free(sound *s) {
+    if (s->dropped > 0) {
+        printf("sound: dropped %llu events, queue full\n", (unsigned long long) s->dropped);
+    }
+    for (int i = 0; i < SOUND_NUM_SAMPLES; i++) {
+        free(s->samples[i].data);
+    }
+    free(s);
+}
+
+static void trigger(sound *s, const int first_sample, const uint8_t old, const uint8_t val, const int bits) {
+    for (int bit = 0; bit < bits; bit++) {
+        const uint8_t mask = 1 << bit;
+        sound_voice *v = &s->voices[first_sample + bit];
+        if ((val & mask) && !(old & mask)) {
+            v->active = true;
+            v->pos = 0;
+        } else if (!(val & mask) && v->loop) {
+            v->active = false;
+        }
+    }
+}
+
+static void apply(sound *s, const sound_event *e) {
+    if (e->port == 3) {
+        trigger(s, 0, s->port3, e->value, 4);
+        trigger(s, 9, s->port3 >> 4, e->value >> 4, 1); // extended play
+        s->port3 = e->value;
+    } else if (e->port == 5) {
+        trigger(s, 4, s->port5, e->value, 5);
+        s->port5 = e->value;
+    }
+}
+
+// Produces the sample at s->cursor, applying every event that is due.
+static int16_t mix_one(sound *s) {
+    uint64_t tail = atomic_load_explicit(&s->tail, memory_order_relaxed);
+    const uint64_t head = atomic_load_explicit(&s->head, memory_order_acquire);
+    while (tail != head && s->queue[tail & (SOUND_QUEUE_SIZE - 1)].cycle <= s->cursor) {
+        apply(s, &s->queue[tail & (SOUND_QUEUE_SIZE - 1)]);
+        tail++;
+    }
+    atomic_store_explicit(&s->tail, tail, memory_order_release);
+    s->cursor += CYCLES_PER_SAMPLE;
+
+    int32_t out = 0;
+    for (int i = 0; i < SOUND_NUM_SAMPLES; i++) {
+        sound_voice *v = &s->voices[i];
+        if (!v->active) continue;
+
+        const sound_sample *sample = &s->samples[i];
+        out += sample->data[v->pos++];
+        if (v->pos >= sample->len) {
+            v->pos = 0;
+            v->active = v->loop;
+        }
+    }
+
+    if (!(s->port3 & SOUND_AMP_ENABLE)) return 0;
+    if (out > INT16_MAX) return INT16_MAX;
+    if (out < INT16_MIN) return INT16_MIN;
+    return out;
+}
+
+void sound_mix(sound *s, int16_t *out, int n) {
+    // Emulation doesn't run exactly at SOUND_CPU_HZ, so keep the cursor
+    // between one frame behind the emulation and the emulation itself.
+    const double now = atomic_load_explicit(&s->now, memory_order_acquire);
+    if (s->cursor > now) {
+        s->cursor = now;
+    } else if (now - s->cursor > SOUND_MAX_LAG_CYCLES) {
+        s->cursor = now - SOUND_MAX_LAG_CYCLES;
+    }
+
+    for (int i = 0; i < n; i++) {
+        out[i] = mix_one(s);
+    }
+}
+
+static void write_wav_header(FILE *f, const uint32_t data_bytes) {
+    uint8_t h[44];
+    const uint32_t byte_rate = SOUND_SAMPLE_RATE * sizeof(int16_t);
+    memcpy(h, "RIFF", 4);
+    const uint32_t riff_len = 36 + data_bytes;
+    memcpy(h + 4, &riff_len, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    const uint32_t fmt_len = 16;
+    const uint16_t format = 1, channels = 1, block_align = 2, bits = 16;
+    const uint32_t rate = SOUND_SAMPLE_RATE;
+    memcpy(h + 16, &fmt_len, 4);
+    memcpy(h + 20, &format, 2);
+    memcpy(h + 22, &channels, 2);
+    memcpy(h + 24, &rate, 4);
+    memcpy(h + 28, &byte_rate, 4);
+    memcpy(h + 32, &block_align, 2);
+    memcpy(h + 34, &bits, 2);
+    memcpy(h + 36, "data", 4);
+    memcpy(h + 40, &data_bytes, 4);
+    fwrite(h, sizeof(h), 1, f);
+}
+
+bool sound_wav_open(sound *s, const char *path) {
+    s->wav = fopen(path, "wb");
+    if (s->wav == NULL) {
+        return false;
+    }
+    s->wav_bytes = 0;
+    write_wav_header(s->wav, 0); // sizes get patched in sound_wav_close()
+    return true;
+}
+
+void sound_render(sound *s, const uint64_t until_cycle) {
+    int16_t buf[1024];
+    int n = 0;
+    while (s->cursor < until_cycle) {
+        buf[n++] = mix_one(s);
+        if (n == sizeof(buf) / sizeof(buf[0])) {
+            fwrite(buf, sizeof(int16_t), n, s->wav);
+            s->wav_bytes += n * sizeof(int16_t);
+            n = 0;
+        }
+    }
+    fwrite(buf, sizeof(int16_t), n, s->wav);
+    s->wav_bytes += n * sizeof(int16_t);
+}
+
+void sound_wav_close(sound *s) {
+    fseek(s->wav, 0L, SEEK_SET);
+    write_wav_header(s->wav, s->wav_bytes);
+    fclose(s->wav);
+    s->wav = NULL;
+}
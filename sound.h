@@ -0,0 +1,90 @@
+#ifndef sound_h
+#define sound_h
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Space Invaders sound. OUT 3 and OUT 5 writes are pushed, timestamped in
+// emulated cycles, onto a single producer/single consumer queue. The mixer
+// runs on whoever consumes the queue: the SDL audio callback (audio.c) or,
+// headless, sound_render() writing a WAV file as fast as we can emulate.
+//
+// Port 3: bit 0 UFO (loops), 1 shot, 2 player dies, 3 invader dies,
+//         4 extended play, 5 amp enable
+// Port 5: bit 0-3 fleet movement 1-4, 4 UFO hit
+//
+// Samples are read from [dir]/0.wav..9.wav (the usual invaders sample set
+// naming), anything missing is replaced by a synthesized stand-in.
+
+#define SOUND_SAMPLE_RATE 44100
+#define SOUND_CPU_HZ 1996800
+#define SOUND_QUEUE_SIZE 1024 // events, must be a power of 2
+#define SOUND_NUM_SAMPLES 10
+#define SOUND_AMP_ENABLE 0x20
+
+// cycles of latency we allow before the mixer skips ahead, one frame
+#define SOUND_MAX_LAG_CYCLES (SOUND_CPU_HZ / 60)
+
+typedef struct {
+    uint64_t cycle;
+    uint8_t port;
+    uint8_t value;
+} sound_event;
+
+typedef struct {
+    int16_t *data;
+    uint32_t len;
+} sound_sample;
+
+typedef struct {
+    uint32_t pos;
+    bool active;
+    bool loop;
+} sound_voice;
+
+typedef struct sound {
+    sound_event queue[SOUND_QUEUE_SIZE];
+    _Atomic uint64_t head; // emulation thread
+    _Atomic uint64_t tail; // mixer
+    _Atomic uint64_t now; // last cycle the emulation thread got to
+    uint64_t dropped;
+
+    // everything below belongs to the mixer
+    sound_sample samples[SOUND_NUM_SAMPLES];
+    sound_voice voices[SOUND_NUM_SAMPLES];
+    uint8_t port3;
+    uint8_t port5;
+    double cursor; // emulated cycle of the next output sample
+
+    FILE *wav;
+    uint32_t wav_bytes;
+} sound;
+
+// NULL when out of memory
+sound* sound_init(const char *sample_dir);
+void sound_free(sound *s);
+
+// Mixer entry points, realtime (clamps to the emulation) and headless.
+void sound_mix(sound *s, int16_t *out, int n);
+bool sound_wav_open(sound *s, const char *path);
+void sound_render(sound *s, uint64_t until_cycle);
+void sound_wav_close(sound *s);
+
+static inline void sound_out(sound *s, const uint64_t cycle, const uint8_t port, const uint8_t value) {
+    const uint64_t head = atomic_load_explicit(&s->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&s->tail, memory_order_acquire) == SOUND_QUEUE_SIZE) {
+        s->dropped++;
+        return;
+    }
+    s->queue[head & (SOUND_QUEUE_SIZE - 1)] = (sound_event) { cycle, port, value };
+    atomic_store_explicit(&s->head, head + 1, memory_order_release);
+}
+
+// Called once per frame so the realtime mixer knows where emulation is.
+static inline void sound_sync(sound *s, const uint64_t cycle) {
+    atomic_store_explicit(&s->now, cycle, memory_order_release);
+}
+
+#endif
@@ -2,11 +2,32 @@
 #include <criterion/assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 #include "cpu.h"
 #include "cpu_plugin.h"
 #include "io.h"
 #include "interrupts.h"
+#include "rom.h"
+#include "lanes.h"
+#include "env.h"
+#include "fbring.h"
+#include "capture.h"
+#include "framehash.h"
+#include "screen.h"
+#include "input.h"
+#include "metrics.h"
+#include "memstats.h"
+#include "opcodes.h"
+#include "disass.h"
+#include "blockindex.h"
+#include "keyframe.h"
+#include "debugger.h"
+#include "trace.h"
+#include "sound.h"
 
 #define PC_BASE 0x0000
 
@@ -17,7 +38,7 @@ void setup() {
 }
 
 void teardown() {
-    free(cpu);
+    free_cpu(cpu);
     cpu = NULL;
 }
 
@@ -51,9 +72,23 @@ void regs() {
 
 TestSuite(cpu, .init = setup, .fini = teardown);
 
+// A loop writing to memory, then PUSH PSW and EI (scalar in lanes) forever
+void load_store_loop() {
+    load_program((uint8_t[]) { 0x21, 0x00, 0x20, 0x06, 0x05, 0x80, 0x77, 0x23, 0x05, 0xc2, 0x05, 0x00,
+        0xf5, 0xfb, 0xc3, 0x0c, 0x00 }, 17);
+}
+
+// LXI H,0x2000, then IN 1 / MOV M,A / INX H / JMP, 32 cycles a loop: the
+// IN of loop i reads at cycle 32 * i + 20 and its byte goes to 0x2000 + i
+void load_in_loop() {
+    load_program((uint8_t[]) { 0x21, 0x00, 0x20, 0xdb, 0x01, 0x77, 0x23, 0xc3, 0x03, 0x00 }, 10);
+    cpu->pc = 0;
+}
+
 Test(cpu, init) {
     cr_assert_not_null(cpu);
-    cr_assert_eq(sizeof(cpu->mem), 0xffff);
+    cr_assert_eq(cpu->mem[0xffff], 0); // true 64K
+    cr_assert_eq((uintptr_t) cpu % CACHE_LINE, 0);
     cr_assert_eq(cpu->pc, PC_BASE);
 }
 
@@ -698,4 +733,729 @@ Test(cpu, rar) {
 
     cr_assert_eq(cpu->f.carry, 1);
     cr_assert_eq(cpu->A, 0x6a);
-}
\ No newline at end of file
+}
+
+#ifndef CPU_8085
+// Cycle counting, conditional CALL/RET cost 6 extra states when taken
+Test(cpu, cycles) {
+    load_program((uint8_t[]) { 0x00, 0xc4, 0x00, 0x00 }, 4);
+    cpu->sp = 0x10;
+    cpu->f.zero = 1;
+
+    exec(cpu); // NOP
+    exec(cpu); // CNZ, not taken
+
+    cr_assert_eq(cpu->cycles, 4 + 11);
+
+    cpu->pc = 0x01;
+    cpu->f.zero = 0;
+    exec(cpu); // CNZ, taken
+
+    cr_assert_eq(cpu->pc, 0x0000);
+    cr_assert_eq(cpu->cycles, 4 + 11 + 17);
+}
+#else
+// 8085 clock states: CNZ is 9 not taken and 18 taken, JZ 7 and 10
+Test(cpu, cycles) {
+    load_program((uint8_t[]) { 0x00, 0xc4, 0x00, 0x00, 0xca, 0x00, 0x00 }, 7);
+    cpu->sp = 0x10;
+    cpu->f.zero = 1;
+
+    exec(cpu); // NOP
+    exec(cpu); // CNZ, not taken
+    exec(cpu); // JZ, taken
+
+    cr_assert_eq(cpu->pc, 0x0000);
+    cr_assert_eq(cpu->cycles, 4 + 9 + 10);
+
+    cpu->pc = 0x01;
+    cpu->f.zero = 0;
+    exec(cpu); // CNZ, taken
+
+    cr_assert_eq(cpu->cycles, 4 + 9 + 10 + 18);
+}
+
+// RIM/SIM masks and the RST 5.5/6.5/7.5 and TRAP vectors by priority
+Test(cpu, interrupts_8085) {
+    // MVI A, 0x0e; SIM; EI; RIM
+    load_program((uint8_t[]) { 0x3e, 0x0e, 0x30, 0xfb, 0x20 }, 5);
+    cpu->sp = 0x100;
+    for (int i = 0; i < 4; i++) exec(cpu);
+
+    cr_assert_eq(cpu->A, 0x0e); // IE, 7.5 and 6.5 masked
+
+    interrupt_8085(cpu, INT_RST75, true); // masked, only latched
+    cr_assert_eq(cpu->pc, 0x05);
+    cpu->pc = 0x04;
+    exec(cpu); // RIM
+    cr_assert_eq(cpu->A, 0x4e);
+
+    interrupt_8085(cpu, INT_RST55, true);
+    cr_assert_eq(cpu->pc, 0x2c);
+    cr_assert(cpu->interrupts_disabled);
+    cr_assert_eq(cpu->mem[0xfe], 0x05);
+
+    // unmasked, the latched 7.5 goes before the still held 5.5, one
+    // instruction after EI
+    cpu->A = 0x08;
+    cpu->pc = 0x02;
+    exec(cpu); // SIM
+    cr_assert_eq(cpu->pc, 0x03);
+    exec(cpu); // EI
+    cr_assert_eq(cpu->pc, 0x04);
+    exec(cpu); // RIM
+    cr_assert_eq(cpu->pc, 0x3c);
+    cr_assert_eq(cpu->mem[0xfc], 0x05);
+    cr_assert_eq(cpu->int_pending, 1 << INT_RST55);
+
+    interrupt_8085(cpu, INT_TRAP, true); // not maskable
+    cr_assert_eq(cpu->pc, 0x24);
+
+    // a handler ending EI; RET with 5.5 still held returns before it's
+    // taken again, the stack doesn't grow
+    cpu->mem[0x2c] = 0xfb;
+    cpu->mem[0x2d] = 0xc9;
+    cpu->int_mask = 0;
+    cpu->pc = 0x2c;
+    cpu->sp = 0xfe;
+    cpu->mem[0xfe] = 0x50;
+    cpu->mem[0xff] = 0x00;
+    for (int i = 0; i < 3; i++) {
+        exec(cpu); // EI
+        exec(cpu); // RET, then RST 5.5 from 0x0050
+        cr_assert_eq(cpu->pc, 0x2c);
+        cr_assert_eq(cpu->sp, 0xfe);
+        cr_assert_eq(cpu->mem[0xfe], 0x50);
+    }
+}
+#endif
+
+// Recursive descent lists what JMP skips as data and labels its target
+Test(cpu, disass_range) {
+    load_program((uint8_t[]) { 0xc3, 0x05, 0x00, 0xaa, 0xbb, 0x00, 0xc9 }, 7);
+
+    char *text = NULL;
+    size_t len = 0;
+    FILE *out = open_memstream(&text, &len);
+    const disass_range_options opt = { .mode = DISASS_RECURSIVE, .start = 0, .end = 7,
+        .entries = (uint16_t[]) { 0x0000 }, .num_entries = 1, .labels = true };
+    cr_assert_eq(disass_range(out, cpu->mem, &opt), 3);
+    fclose(out);
+
+    cr_assert_str_eq(text,
+        "0000 c3 05 00\tJMP $0005\n"
+        "0003 aa    \tDB $#aa\n"
+        "0004 bb    \tDB $#bb\n"
+        "L0005:\n"
+        "0005 00    \tNOP\n"
+        "0006 c9    \tRET\n");
+    free(text);
+}
+
+// Blocks split at branches, calls and their targets, what nothing reaches is data
+Test(cpu, block_index) {
+    load_program((uint8_t[]) {
+        0x3e, 0x01,       // 0000 MVI A, 1
+        0xca, 0x09, 0x00, // 0002 JZ 0009
+        0xcd, 0x0d, 0x00, // 0005 CALL 000d
+        0x76,             // 0008 HLT
+        0xc3, 0x00, 0x00, // 0009 JMP 0000
+        0x08,             // 000c data
+        0xc9,             // 000d RET
+    }, 14);
+
+    char path[] = "/tmp/blkXXXXXX";
+    close(mkstemp(path));
+    cr_assert(block_index_write(path, cpu->mem, 0, 14, 0x1234, (uint16_t[]) { 0x0000 }, 1, NULL));
+    block_index *idx = block_index_open(path);
+    unlink(path);
+    cr_assert_not_null(idx);
+
+    cr_assert_eq(idx->header->num_blocks, 5);
+    cr_assert_eq(idx->header->instructions, 6);
+    cr_assert_eq(idx->header->code_bytes, 13);
+
+    const block_entry *b = block_index_find(idx, 0x0003);
+    cr_assert_eq(b->start, 0x0000);
+    cr_assert_eq(b->length, 5);
+    cr_assert_eq(b->num_succ, 2);
+    cr_assert_eq(b->succ[0], 0x0009);
+    cr_assert_eq(b->succ[1], 0x0005);
+
+    b = block_index_find(idx, 0x0005);
+    cr_assert_eq(b->flags, BLOCK_CALL);
+    cr_assert_eq(b->succ[1], 0x0008);
+    cr_assert_eq(block_index_find(idx, 0x0008)->succ[0], 0x0009);
+    cr_assert_eq(block_index_find(idx, 0x000d)->flags, BLOCK_INDIRECT);
+
+    cr_assert_null(block_index_find(idx, 0x000c));
+    cr_assert(!block_index_code(idx, 0x000c));
+    cr_assert(block_index_code(idx, 0x000b));
+    block_index_close(idx);
+}
+
+// The interpreter charges every opcode the way opcodes[] says, and its
+// bodies, which move pc themselves, step by the table's lengths. A
+// conditional branch goes one way with all flags clear and the other with
+// all set
+Test(cpu, opcode_table) {
+    for (int op = 0; op < 256; op++) {
+        const op_info *info = &opcodes[op];
+        if (info->flow == FLOW_INVALID) continue;
+
+        uint64_t states = 0;
+        int taken = 0;
+        for (int set = 0; set < 2; set++) {
+            memset(&cpu->f, set ? 0xff : 0, sizeof(flags));
+            cpu->pc = 0x100;
+            cpu->sp = 0x200;
+            cpu->HL = 0x300;
+            cpu->exit = false;
+            load(cpu, 0x100, (uint8_t[]) { op, 0x06, 0x12 }, 3); // OUT 6 goes nowhere
+            load(cpu, 0x200, (uint8_t[]) { 0x00, 0x00 }, 2);
+
+            const uint64_t before = cpu->cycles;
+            exec(cpu);
+            states += cpu->cycles - before;
+            cr_assert(!cpu->exit, "%02x %s", op, info->mnemonic);
+            if (info->flow == FLOW_NEXT || info->flow == FLOW_HALT) {
+                cr_assert_eq(cpu->pc, 0x100 + info->length, "%02x %s", op, info->mnemonic);
+            }
+            taken += cpu->pc != 0x100 + info->length;
+        }
+
+        if (info->flow == FLOW_JUMP_COND || info->flow == FLOW_CALL_COND || info->flow == FLOW_RET_COND) {
+            cr_assert_eq(taken, 1, "%02x %s", op, info->mnemonic);
+            cr_assert_eq(states, 2 * info->cycles + info->taken, "%02x %s", op, info->mnemonic);
+        } else {
+            cr_assert_eq(states, 2 * info->cycles, "%02x %s", op, info->mnemonic);
+        }
+    }
+}
+
+// Every machine maps the same ROM pages, writes stay private to one machine
+Test(cpu, rom_load) {
+    char path[] = "/tmp/romXXXXXX";
+    const int fd = mkstemp(path);
+    uint8_t image[0x2000];
+    for (size_t i = 0; i < sizeof(image); i++) image[i] = i * 7;
+    cr_assert_eq(write(fd, image, sizeof(image)), sizeof(image));
+    close(fd);
+
+    rom_image *rom = rom_open(path, 0);
+    unlink(path);
+    cr_assert_not_null(rom);
+    cr_assert_eq(rom->crc32, crc32(image, sizeof(image)));
+    cr_assert_null(rom->set); // the size of the invaders set, not its crc
+
+    CPU *other = init(0);
+    rom_load(cpu, rom);
+    rom_load(other, rom);
+    cr_assert_arr_eq(cpu->mem, image, sizeof(image));
+
+    cpu->mem[0x10] = 0xff;
+    cr_assert_eq(other->mem[0x10], image[0x10]);
+    cr_assert_eq(rom->data[0x10], image[0x10]);
+
+    free_cpu(other);
+    rom_close(rom);
+}
+
+// run() stops after the instruction that hit a stop condition
+Test(cpu, run_stops) {
+    load_program((uint8_t[]) { 0x00, 0x32, 0x00, 0x24, 0xd3, 0x06, 0xfb, 0x76, 0x00, 0x00 }, 10);
+    const run_stop vram = { .on = RUN_STOP_WRITE, .write_start = 0x2400, .write_end = 0x3fff };
+    const run_stop all = { .on = RUN_STOP_OUT | RUN_STOP_INTERRUPT | RUN_STOP_HALT | RUN_STOP_PC, .pc = 0x09 };
+
+    cr_assert_eq(run(cpu, 4, NULL), RUN_BUDGET);
+    cr_assert_eq(cpu->pc, 0x01);
+
+    cpu->A = 0xad;
+    cr_assert_eq(run(cpu, 1000, &vram), RUN_WRITE);
+    cr_assert_eq(cpu->pc, 0x04);
+    cr_assert_eq(cpu->mem[0x2400], 0xad);
+    cr_assert_eq(cpu->cycles, 4 + 13);
+
+    cr_assert_eq(run(cpu, 1000, &all), RUN_OUT);
+    cr_assert_eq(cpu->pc, 0x06);
+    cr_assert_eq(run(cpu, 1000, &all), RUN_INTERRUPT);
+    cr_assert_eq(run(cpu, 1000, &all), RUN_HALT);
+    cr_assert_eq(cpu->pc, 0x08);
+    cr_assert_eq(run(cpu, 1000, &all), RUN_PC);
+    cr_assert_eq(cpu->pc, 0x09);
+}
+
+Test(cpu, lanes_match_exec) {
+    load_store_loop();
+#ifdef CPU_8085
+    cpu->mem[0x3c] = 0xc9; // RST 5.5 returns at once
+#endif
+
+    CPU *machines[LANES], *expected[LANES];
+    for (int i = 0; i < LANES; i++) {
+        machines[i] = clone_cpu(cpu);
+        machines[i]->A = i * 37;
+        if (i % 2) { // odd lanes skip the LXI and write elsewhere
+            machines[i]->pc = 0x03;
+            machines[i]->H = 0x30;
+        }
+#ifdef CPU_8085
+        if (i < LANES / 2) { // taken one instruction after every EI
+            machines[i]->int_pending = 1 << INT_RST55;
+        }
+#endif
+        expected[i] = clone_cpu(machines[i]);
+    }
+
+    lanes *l = lanes_open(machines, LANES);
+    cr_assert_not_null(l);
+    lanes_run(l, 300);
+    lanes_close(l);
+
+    for (int i = 0; i < LANES; i++) {
+        run(expected[i], 300, NULL);
+        cr_assert_eq(memcmp(machines[i], expected[i], offsetof(CPU, mem)), 0);
+        cr_assert_eq(memcmp(machines[i]->mem, expected[i]->mem, MEM_SIZE), 0);
+#ifdef CPU_8085
+        // past the memcmp above
+        cr_assert_eq(machines[i]->ei_delay, expected[i]->ei_delay);
+        cr_assert_eq(machines[i]->int_pending, expected[i]->int_pending);
+        cr_assert(i < LANES / 2 || !machines[i]->interrupts_disabled);
+#else
+        cr_assert_eq(machines[i]->interrupts_disabled, false);
+#endif
+        free_cpu(machines[i]);
+        free_cpu(expected[i]);
+    }
+}
+
+Test(cpu, env_step_reset) {
+    // RST 1/2 just return, the main loop sets 1 ship, game running,
+    // score 0120 and a VRAM byte, then spins
+    uint8_t program[0x40] = { 0xc3, 0x20, 0x00 };
+    memcpy(&program[0x08], (uint8_t[]) { 0xfb, 0xc9 }, 2);
+    memcpy(&program[0x10], (uint8_t[]) { 0xfb, 0xc9 }, 2);
+    memcpy(&program[0x20], (uint8_t[]) { 0x3e, 0x01, 0x32, 0xff, 0x21, 0x32, 0xef, 0x20, 0x3e, 0x20, 0x32, 0xf8, 0x20,
+        0x32, 0x00, 0x24, 0x3e, 0x01, 0x32, 0xf9, 0x20, 0xc3, 0x35, 0x00 }, 24);
+    char path[] = "/tmp/romXXXXXX";
+    const int fd = mkstemp(path);
+    cr_assert_eq(write(fd, program, sizeof(program)), sizeof(program));
+    close(fd);
+    rom_image *rom = rom_open(path, 0);
+    unlink(path);
+
+    env *e = env_open(rom, 3, -1, 0, 2);
+    cr_assert_not_null(e);
+    cr_assert_eq(e->infos[1].playing, false);
+
+    const uint8_t actions[3] = { ENV_FIRE, 0, ENV_LEFT };
+    env_step(e, actions, 1);
+    for (int i = 0; i < 3; i++) {
+        cr_assert_eq(env_obs(e, i)[0], 0x20); // straight from the machine's VRAM
+        cr_assert_eq(e->infos[i].score, 120);
+        cr_assert_eq(e->infos[i].reward, 120);
+        cr_assert_eq(e->infos[i].lives, 1);
+        cr_assert_eq(e->infos[i].playing, true);
+    }
+    cr_assert_eq(e->machines[2]->io_ports[1], ENV_LEFT);
+
+    env_reset(e, 1);
+    cr_assert_eq(env_obs(e, 1)[0], 0);
+    cr_assert_eq(e->infos[1].score, 0);
+    cr_assert_eq(e->machines[1]->pc, 0);
+    cr_assert_eq(env_obs(e, 2)[0], 0x20);
+
+    env_close(e);
+    rom_close(rom);
+}
+
+Test(cpu, fbring_publish) {
+    char name[64];
+    snprintf(name, sizeof(name), "/emu-test-%d", getpid());
+    fbring *r = fbring_create(name);
+    cr_assert_not_null(r);
+    const fbring *view = fbring_attach(name);
+    cr_assert_not_null(view);
+    cr_assert_eq(fbring_frames(view), 0);
+
+    for (int i = 0; i < FBRING_SLOTS + 3; i++) {
+        cpu->mem[FBRING_VRAM] = i;
+        cpu->mem[FBRING_VRAM + FBRING_FRAME_SIZE - 1] = ~i;
+        fbring_publish(r, &cpu->mem[FBRING_VRAM], i * 100);
+    }
+
+    const uint64_t n = fbring_frames(view);
+    cr_assert_eq(n, FBRING_SLOTS + 3);
+    const fbring_slot *s = &view->slot[(n - 1) % FBRING_SLOTS];
+    const uint64_t seq = fbring_begin(s);
+    cr_assert_eq(s->frame, n - 1);
+    cr_assert_eq(s->cycles, (n - 1) * 100);
+    cr_assert_eq(s->vram[0], n - 1);
+    cr_assert_eq(s->vram[FBRING_FRAME_SIZE - 1], (uint8_t) ~(n - 1));
+    cr_assert(fbring_end(s, seq));
+
+    // the producer lapping a reader makes its read fail
+    fbring_publish(r, &cpu->mem[FBRING_VRAM], 0);
+    const fbring_slot *oldest = &view->slot[n % FBRING_SLOTS];
+    const uint64_t stale = fbring_begin(oldest) - 2;
+    cr_assert_not(fbring_end(oldest, stale));
+
+    fbring_detach(view);
+    fbring_destroy(r, name);
+    cr_assert_null(fbring_attach(name));
+}
+
+Test(cpu, capture_raw) {
+    char path[] = "/tmp/captureXXXXXX";
+    close(mkstemp(path));
+    capture *c = capture_open(path, 0, false);
+    cr_assert_not_null(c);
+
+    cpu->mem[CAPTURE_VRAM] = 0x01; // bottom left pixel
+    for (int i = 0; i < CAPTURE_QUEUE_SIZE * 2; i++) {
+        capture_frame(c, &cpu->mem[CAPTURE_VRAM]);
+    }
+    capture_close(c);
+
+    FILE *f = fopen(path, "rb");
+    uint8_t gray[CAPTURE_WIDTH * CAPTURE_HEIGHT];
+    for (int i = 0; i < CAPTURE_QUEUE_SIZE * 2; i++) {
+        cr_assert_eq(fread(gray, sizeof(gray), 1, f), 1);
+        cr_assert_eq(gray[(CAPTURE_HEIGHT - 1) * CAPTURE_WIDTH], 255);
+        cr_assert_eq(gray[(CAPTURE_HEIGHT - 2) * CAPTURE_WIDTH], 0);
+    }
+    cr_assert_eq(fread(gray, 1, 1, f), 0);
+    fclose(f);
+    unlink(path);
+}
+
+Test(cpu, framehash_log) {
+    char path[] = "/tmp/framehashXXXXXX";
+    close(mkstemp(path));
+    framehash_log *log = framehash_create(path);
+    cr_assert_not_null(log);
+
+    const uint64_t blank = framehash(&cpu->mem[FRAMEHASH_VRAM]);
+    framehash_append(log, &cpu->mem[FRAMEHASH_VRAM]);
+    cpu->mem[0x3fff] = 0x80; // last pixel
+    cr_assert_neq(framehash(&cpu->mem[FRAMEHASH_VRAM]), blank);
+    framehash_append(log, &cpu->mem[FRAMEHASH_VRAM]);
+    cpu->mem[0x3fff] = 0;
+    cr_assert_eq(framehash(&cpu->mem[FRAMEHASH_VRAM]), blank);
+    framehash_close(log);
+
+    uint64_t frames;
+    uint64_t *hashes = framehash_load(path, &frames);
+    cr_assert_eq(frames, 2);
+    cr_assert_eq(hashes[0], blank);
+    cr_assert_neq(hashes[1], blank);
+    free(hashes);
+    unlink(path);
+}
+
+Test(cpu, screen_overlay) {
+    screen *s = screen_open(2, true);
+    uint32_t *pixels = calloc(SCREEN_WIDTH * 2 * SCREEN_HEIGHT * 2, sizeof(uint32_t));
+    const int pitch = SCREEN_WIDTH * 2;
+
+    cpu->mem[SCREEN_VRAM] = 0x01; // bottom left pixel, white
+    cpu->mem[SCREEN_VRAM + 20 * 32 + 2] = 0x01; // x 20, 16 up, green
+    cpu->mem[SCREEN_VRAM + 20 * 32 + 26] = 0x80; // x 20, 215 up, red
+    screen_render(s, &cpu->mem[SCREEN_VRAM], pixels);
+
+    for (int k = 0; k < 4; k++) { // 2x2
+        cr_assert_eq(pixels[(511 - k / 2) * pitch + k % 2], 0xffffffff);
+        cr_assert_eq(pixels[(2 * 239 + k / 2) * pitch + 40 + k % 2], 0xff20ff20);
+        cr_assert_eq(pixels[(2 * 40 + k / 2) * pitch + 40 + k % 2], 0xffff2020);
+    }
+    cr_assert_eq(pixels[511 * pitch + 2], 0xff000000);
+    cr_assert_eq(pixels[509 * pitch], 0xff000000);
+
+    free(pixels);
+    screen_close(s);
+}
+
+// The scratch machine runs ahead on the input held so far and shows a frame
+// the real one hasn't got to, which gets there only when the input is due
+Test(cpu, copy_cpu_runahead) {
+    load_in_loop();
+
+    input *in = input_open(NULL);
+    input_push(in, 50000, 1, 0x10, true); // in the second frame from now
+    cpu->input = in;
+    run(cpu, CYCLES_PER_FRAME, NULL);
+
+    CPU *ahead = init(0);
+    ahead->A = 0xff;
+    ahead->mem[0x3000] = 0xff;
+    copy_cpu(ahead, cpu);
+    cr_assert_eq(ahead->mem[0x3000], 0);
+    ahead->input = NULL;
+    input_ahead(in, ahead);
+    cr_assert_eq(ahead->io_ports[1], 0x10);
+    cr_assert_eq(cpu->io_ports[1], 0);
+    cr_assert_eq(in->next, 0);
+
+    run(ahead, 2 * CYCLES_PER_FRAME, NULL);
+    cr_assert_eq(ahead->mem[0x2500], 0x10);
+    cr_assert_eq(cpu->mem[0x2500], 0);
+    cr_assert_neq(memcmp(&ahead->mem[0x2400], &cpu->mem[0x2400], 0x1c00), 0);
+
+    // the real machine reads the press only once it's due, from there on
+    // it writes what the frame shown ahead did
+    run(cpu, 2 * CYCLES_PER_FRAME, NULL);
+    cpu->input = NULL;
+    cr_assert_eq(in->applied, 1);
+    cr_assert_eq(ahead->cycles, cpu->cycles);
+    cr_assert_eq(ahead->HL, cpu->HL);
+    const uint8_t *pressed = memchr(&cpu->mem[0x2000], 0x10, cpu->HL - 0x2000);
+    cr_assert_not_null(pressed);
+    const uint16_t at = pressed - cpu->mem;
+    cr_assert(at > 0x2500);
+    cr_assert_eq(memcmp(&ahead->mem[at], &cpu->mem[at], cpu->HL - at), 0);
+
+    free_cpu(ahead);
+    input_close(in);
+}
+
+Test(cpu, input_at_cycle) {
+    load_in_loop();
+
+    input *in = input_open(NULL);
+    input_push(in, 100, 1, 0x10, true); // pressed and released within a frame
+    input_push(in, 200, 1, 0x10, false);
+    cpu->input = in;
+    run(cpu, 300, NULL);
+    cpu->input = NULL;
+
+    cr_assert_eq(cpu->mem[0x2002], 0);
+    cr_assert_eq(cpu->mem[0x2003], 0x10);
+    cr_assert_eq(cpu->mem[0x2005], 0x10);
+    cr_assert_eq(cpu->mem[0x2006], 0);
+    cr_assert_eq(in->applied, 2);
+    input_close(in);
+}
+
+// A segment replayed from the middle keyframe, with the input picked up
+// where that keyframe left it, ends at the last one
+Test(cpu, keyframe_segment) {
+    load_in_loop();
+    cpu->interrupts_disabled = true; // no RSTs into the loop
+
+    char path[] = "/tmp/keyXXXXXX";
+    close(mkstemp(path));
+    keyframe_log *log = keyframe_create(path, 0x1234, 0, 0, 1);
+    cr_assert_not_null(log);
+
+    input *in = input_open(NULL);
+    input_push(in, 1000, 1, 0x04, true);
+    input_push(in, 40000, 1, 0x04, false); // in the second frame
+    input_push(in, 50000, 1, 0x01, true);
+    cpu->input = in;
+    for (uint64_t frame = 0; frame < 2; frame++) {
+        cr_assert(keyframe_append(log, cpu, frame, in->applied));
+        keyframe_run_frames(cpu, 1);
+    }
+    cr_assert(keyframe_append(log, cpu, 2, in->applied));
+    keyframe_close(log);
+    cpu->input = NULL;
+
+    keyframe_file *kf = keyframe_open(path);
+    unlink(path);
+    cr_assert_not_null(kf);
+    cr_assert_eq(kf->count, 3);
+    cr_assert_eq(kf->frames[1].input_applied, 1);
+    cr_assert_eq(kf->frames[2].hash, state_hash(cpu));
+
+    CPU *replay = init(0);
+    keyframe_restore(replay, &kf->frames[1]);
+    cr_assert_eq(state_hash(replay), kf->frames[1].hash);
+    input_seek(in, kf->frames[1].input_applied);
+    replay->input = in;
+    keyframe_run_frames(replay, 1);
+    replay->input = NULL;
+    cr_assert_eq(state_hash(replay), kf->frames[2].hash);
+    cr_assert_eq(replay->mem[0x2000 + 1300], 0);
+    cr_assert_eq(replay->mem[0x2000 + 1600], 0x01);
+
+    // without the input the segment ends somewhere else
+    keyframe_restore(replay, &kf->frames[1]);
+    keyframe_run_frames(replay, 1);
+    cr_assert_neq(state_hash(replay), kf->frames[2].hash);
+
+    free_cpu(replay);
+    keyframe_file_close(kf);
+    input_close(in);
+}
+
+Test(cpu, metrics_histogram) {
+    // within 1/16 of the value, in order, clamped at the top
+    for (uint64_t ns = 1; ns < (1ULL << 40); ns = ns * 3 / 2 + 1) {
+        cr_assert(metrics_bucket(ns) <= metrics_bucket(ns + ns / 16 + 1));
+        cr_assert(metrics_bucket(ns) < METRIC_BUCKETS);
+    }
+    cr_assert_eq(metrics_bucket(UINT64_MAX), METRIC_BUCKETS - 1);
+
+    metrics *m = metrics_open(NULL, NULL);
+    metrics_add(m, METRIC_FRAMES, 3);
+    metrics_record(m, METRIC_EMULATION, 1500); // 1.5us
+    metrics_record(m, METRIC_EMULATION, 40000); // 40us
+    metrics_record(m, METRIC_EMULATION, 41000);
+
+    char *text;
+    size_t len;
+    FILE *f = open_memstream(&text, &len);
+    metrics_write(m, f);
+    fclose(f);
+    cr_assert_not_null(strstr(text, "\nemu_frames_total 3\n"));
+    cr_assert_not_null(strstr(text, "\nemu_frame_emulation_seconds_bucket{le=\"2.048e-06\"} 1\n"));
+    cr_assert_not_null(strstr(text, "\nemu_frame_emulation_seconds_bucket{le=\"6.5536e-05\"} 3\n"));
+    cr_assert_not_null(strstr(text, "\nemu_frame_emulation_seconds_count 3\n"));
+    cr_assert_not_null(strstr(text, "\nemu_frame_emulation_seconds_max 4.1e-05\n"));
+    free(text);
+    metrics_close(m);
+}
+
+Test(cpu, memstats_pages) {
+    // MVI A,1 / STA 0x2410 / PUSH B / LDA 0x3000 / POP B / JMP $
+    load_program((uint8_t[]) { 0x3e, 0x01, 0x32, 0x10, 0x24, 0xc5, 0x3a, 0x00, 0x30, 0xc1, 0xc3, 0x0a, 0x00 }, 13);
+    cpu->pc = 0;
+
+    memstats *s = memstats_open("/dev/null", cpu);
+    cr_assert_not_null(s);
+    for (int i = 0; i < 10; i++) {
+        memstats_exec(s, cpu);
+        exec(cpu);
+    }
+    cr_assert_eq(s->fetches[0x00], 10);
+    cr_assert_eq(s->writes[0x24], 1);
+    cr_assert_eq(s->writes[0x23], 2); // PUSH
+    cr_assert_eq(s->reads[0x23], 2); // POP
+    cr_assert_eq(s->reads[0x30], 1);
+    cr_assert_eq(s->frame_writes, 3);
+    cr_assert_eq(s->min_sp, 0x23fd);
+    cr_assert_eq(s->min_sp_pc, 0x06);
+    cr_assert(s->written[0x2410 >> 3] & 1);
+
+    memstats_frame(s);
+    cr_assert_eq(s->frame_writes, 0);
+    cr_assert_not(s->written[0x2410 >> 3]);
+    memstats_close(s);
+}
+
+// Every traced instruction comes back from the file in order, with the
+// registers from before it ran
+Test(cpu, trace_records) {
+    // MVI A,0x42 / LXI H,0x1234 / NOP
+    load_program((uint8_t[]) { 0x3e, 0x42, 0x21, 0x34, 0x12, 0x00 }, 6);
+
+    char path[] = "/tmp/traceXXXXXX";
+    close(mkstemp(path));
+    tracer *t = trace_open(path);
+    cr_assert_not_null(t);
+    for (int i = 0; i < 3; i++) {
+        trace_exec(t, cpu);
+        exec(cpu);
+    }
+    trace_close(t);
+
+    FILE *f = fopen(path, "rb");
+    trace_header header;
+    cr_assert_eq(fread(&header, sizeof(header), 1, f), 1);
+    cr_assert_eq(memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)), 0);
+    cr_assert_eq(header.record_size, sizeof(trace_record));
+
+    trace_record r[4];
+    cr_assert_eq(fread(r, sizeof(trace_record), 4, f), 3);
+    fclose(f);
+    unlink(path);
+
+    cr_assert_eq(r[0].pc, 0x0000);
+    cr_assert_eq(r[0].cycles, 0);
+    cr_assert_eq(r[0].op[0], 0x3e);
+    cr_assert_eq(r[0].op[1], 0x42);
+    cr_assert_eq(r[1].pc, 0x0002);
+    cr_assert_eq(r[1].A, 0x42);
+    cr_assert_eq(r[1].cycles, opcodes[0x3e].cycles);
+    cr_assert_eq(r[1].op[2], 0x12);
+    cr_assert_eq(r[2].pc, 0x0005);
+    cr_assert_eq(r[2].HL, 0x1234);
+    cr_assert_eq(r[2].sp, cpu->sp);
+}
+
+// Headless sound: the shot starts at once but stays silent until the amp
+// is enabled, the WAV header's sizes match what was rendered
+Test(cpu, sound_wav) {
+    sound *s = sound_init(NULL); // synthesized samples
+    cr_assert_not_null(s);
+    char path[] = "/tmp/soundXXXXXX";
+    close(mkstemp(path));
+    cr_assert(sound_wav_open(s, path));
+
+    sound_out(s, 0, 3, 0x02);
+    sound_out(s, 20000, 3, SOUND_AMP_ENABLE | 0x02);
+    sound_render(s, 40000);
+    sound_wav_close(s);
+    sound_free(s);
+
+    FILE *f = fopen(path, "rb");
+    _Alignas(int16_t) uint8_t wav[44 + 2000 * sizeof(int16_t)];
+    const size_t size = fread(wav, 1, sizeof(wav), f);
+    fclose(f);
+    unlink(path);
+
+    uint32_t riff_len, data_len;
+    memcpy(&riff_len, wav + 4, 4);
+    memcpy(&data_len, wav + 40, 4);
+    cr_assert_eq(memcmp(wav, "RIFF", 4), 0);
+    cr_assert_eq(memcmp(wav + 36, "data", 4), 0);
+    cr_assert_eq(data_len, size - 44);
+    cr_assert_eq(riff_len, 36 + data_len);
+    cr_assert_eq(data_len / sizeof(int16_t), (40000 * SOUND_SAMPLE_RATE + SOUND_CPU_HZ - 1) / SOUND_CPU_HZ);
+
+    const int16_t *pcm = (const int16_t*) (wav + 44);
+    const size_t amp_on = 20000 * SOUND_SAMPLE_RATE / SOUND_CPU_HZ;
+    size_t loud = 0;
+    for (size_t i = 0; i < data_len / sizeof(int16_t); i++) {
+        if (i < amp_on) cr_assert_eq(pcm[i], 0);
+        else loud += pcm[i] != 0;
+    }
+    cr_assert(loud > 0);
+}
+
+// Packets sent while running are answered in order until c resumes, lengths
+// that would wrap the reply or the write past their buffers are refused
+Test(cpu, debugger_packets) {
+    int sv[2];
+    cr_assert_eq(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+    debugger *d = calloc(1, sizeof(debugger));
+    d->fd = sv[0];
+    d->listen_fd = -1;
+    cpu->mem[0xfffe] = 0xab;
+    cpu->mem[0xffff] = 0xcd;
+    cpu->mem[0x0000] = 0x12;
+
+    const char *packets = "$mfffe,3#00$M10,2:beef#00$m10,2#00"
+        "$m0,80000000#00$M0,80000001:00#00$m0,800#00$c#00";
+    cr_assert_eq(write(sv[1], packets, strlen(packets)), strlen(packets));
+    debugger_poll(d, cpu);
+
+    char reply[256];
+    const ssize_t n = read(sv[1], reply, sizeof(reply) - 1);
+    cr_assert(n > 0);
+    reply[n] = '\0';
+    cr_assert_str_eq(reply, "+$abcd12#ed+$OK#9a+$beef#92+$E01#a6+$E01#a6+$E01#a6+");
+    cr_assert_eq(cpu->mem[0x0001], 0);
+
+    close(sv[0]);
+    close(sv[1]);
+    free(d);
+
+    // a socket that can't be bound doesn't leak its descriptor
+    const int before = dup(0);
+    close(before);
+    cr_assert_null(debugger_open("/nonexistent/emu-test.sock", cpu));
+    const int after = dup(0);
+    close(after);
+    cr_assert_eq(after, before);
+}
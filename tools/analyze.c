@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "rom.h"
+#include "trace.h"
+#include "blockindex.h"
+
+// Offline rom analysis: follows the code from the reset and interrupt
+// vectors (or the base address), from -e addresses and from every pc of
+// -t execution traces (see trace.c), and writes the code/data map and
+// basic block index of blockindex.h. `emu --blocks` maps it at startup.
+// Prints how long the analysis took and how much of the rom it found to
+// be code.
+//
+// usage: emu-analyze [-e entry]... [-t trace.bin]... rom $base_addr out.blk
+
+#define MAX_ENTRIES 16
+#define MAX_TRACES 8
+
+static uint8_t mem[MEM_SIZE + 2];
+static uint8_t observed[MEM_SIZE];
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Marks every pc the trace ran the rom's own bytes at, returns how many records
+static long read_trace(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return -1;
+    trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.record_size != sizeof(trace_record)) {
+        fclose(f);
+        return -1;
+    }
+
+    long records = 0;
+    trace_record r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        // code the rom copied to RAM, or a trace of another rom
+        if (r.op[0] == mem[r.pc]) observed[r.pc] = 1;
+        records++;
+    }
+    fclose(f);
+    return records;
+}
+
+int main(int argc, char **argv) {
+    uint16_t entries[MAX_ENTRIES + 3]; // and the vectors or base_addr below
+    int num_entries = 0;
+    const char *traces[MAX_TRACES];
+    int num_traces = 0;
+
+    int arg = 1;
+    for (; arg + 1 < argc; arg += 2) {
+        if (strcmp(argv[arg], "-e") == 0 && num_entries < MAX_ENTRIES) {
+            entries[num_entries++] = strtol(argv[arg + 1], NULL, 16);
+        } else if (strcmp(argv[arg], "-t") == 0 && num_traces < MAX_TRACES) {
+            traces[num_traces++] = argv[arg + 1];
+        } else {
+            break;
+        }
+    }
+    if (arg + 3 != argc) {
+        printf("usage: %s [-e entry]... [-t trace.bin]... rom $base_addr out.blk\n", argv[0]);
+        exit(1);
+    }
+
+    const uint16_t base_addr = strtol(argv[arg + 1], NULL, 16);
+    rom_image *rom = rom_open(argv[arg], base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[arg]);
+        exit(1);
+    }
+    const uint32_t size = rom->size < (size_t) (MEM_SIZE - base_addr) ? rom->size : MEM_SIZE - base_addr;
+    memcpy(&mem[base_addr], rom->data, size);
+
+    if (base_addr == 0) {
+        entries[num_entries++] = 0x0000;
+        entries[num_entries++] = 0x0008;
+        entries[num_entries++] = 0x0010;
+    } else {
+        entries[num_entries++] = base_addr;
+    }
+
+    for (int t = 0; t < num_traces; t++) {
+        const long records = read_trace(traces[t]);
+        if (records < 0) {
+            printf("%s: not a trace file\n", traces[t]);
+            exit(1);
+        }
+        printf("trace %s: %ld records\n", traces[t], records);
+    }
+
+    const double start = now_seconds();
+    if (!block_index_write(argv[arg + 2], mem, base_addr, size, rom->crc32, entries, num_entries,
+            num_traces ? observed : NULL)) {
+        printf("block_index_write %s\n", argv[arg + 2]);
+        exit(1);
+    }
+    const double seconds = now_seconds() - start;
+
+    block_index *idx = block_index_open(argv[arg + 2]);
+    if (idx == NULL) {
+        printf("block_index_open %s\n", argv[arg + 2]);
+        exit(1);
+    }
+    const block_index_header *h = idx->header;
+    int indirect = 0, calls = 0, traced = 0;
+    uint32_t traced_bytes = 0;
+    for (uint32_t i = 0; i < h->num_blocks; i++) {
+        const block_entry *b = &idx->blocks[i];
+        indirect += (b->flags & BLOCK_INDIRECT) != 0;
+        calls += (b->flags & BLOCK_CALL) != 0;
+        if (b->flags & BLOCK_TRACED) {
+            traced++;
+            traced_bytes += b->length;
+        }
+    }
+
+    printf("rom: %s, crc32: %08x, base_addr: 0x%04x, %u bytes\n", argv[arg], h->rom_crc32, h->base_addr, h->rom_size);
+    printf("analysis: %.3f ms\n", seconds * 1e3);
+    printf("code: %u bytes (%.1f%%), %u instructions, data or unreached: %u bytes\n", h->code_bytes,
+        h->rom_size ? 100.0 * h->code_bytes / h->rom_size : 0, h->instructions, h->rom_size - h->code_bytes);
+    printf("blocks: %u, %.1f instructions on average, %d end in a call, %d indirect (RET/PCHL)\n", h->num_blocks,
+        h->num_blocks ? (double) h->instructions / h->num_blocks : 0, calls, indirect);
+    if (num_traces) {
+        printf("traces: %d blocks, %u bytes found only through the traced pcs\n", traced, traced_bytes);
+    }
+    printf("index: %s, %zu bytes\n", argv[arg + 2], idx->map_size);
+
+    block_index_close(idx);
+    rom_close(rom);
+    return 0;
+}
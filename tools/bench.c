@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "cpu_plugin.h"
+#include "interrupts.h"
+#include "rom.h"
+#include "lanes.h"
+#ifdef AOT
+#include "aot.h"
+#endif
+
+// Instruction loop throughput: runs a rom headless for a fixed number of
+// emulated cycles, a few times from a fresh machine, and reports the best
+// run. "exec" calls exec() per instruction like a plain caller loop, "run"
+// hands the whole budget to run(), "aot" to the recompiled code in
+// emu-bench-aot. CP/M roms get the same zero page as
+// emu-diag, anything else gets main.c's frame interrupts.
+//
+// -m runs that many machines side by side, each for the cycle budget, and
+// reports their total. "lanes" runs them LANES at a time through
+// lanes_run(), the others one after the other per half frame. -s starts
+// machine n n*skew cycles in, so lanes don't all run the same code.
+//
+// usage: emu-bench [-e exec|run|lanes|aot] [-c cycles] [-r runs] [-m machines] [-s skew]
+//                  [rom $base_addr emu_cpm_os:1|0]
+
+#define DEFAULT_ROM "diag/8080EXER.COM"
+#define DEFAULT_CYCLES 800000000ULL
+#define DEFAULT_RUNS 3
+
+#define CPM_BDOS_TOP 0xf000
+#define MAX_MACHINES 256
+
+typedef struct {
+    const char *name;
+    run_reason (*run)(CPU* cpu, const uint64_t cycles); // NULL = exec() loop
+    bool lanes;
+} engine;
+
+static run_reason run_plain(CPU* cpu, const uint64_t cycles) {
+    return run(cpu, cycles, NULL);
+}
+
+static const engine engines[] = {
+    { "exec", NULL, false },
+    { "run", run_plain, false },
+    { "lanes", NULL, true },
+#ifdef AOT
+    { "aot", aot_run, false },
+#endif
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    uint64_t cycles; // all machines
+    uint64_t instructions; // 0 when they weren't counted
+    uint64_t groups, vector_ops, scalar_ops, diverged, calls; // lanes only
+} result;
+
+static CPU* machine(const rom_image *rom, bool cpm) {
+    CPU *cpu = init(rom->base_addr);
+    rom_load(cpu, rom);
+    if (cpm) {
+        cpu->mem[5] = 0xc9;
+        cpu->mem[6] = CPM_BDOS_TOP & 0xff;
+        cpu->mem[7] = CPM_BDOS_TOP >> 8;
+    }
+    return cpu;
+}
+
+static result bench(const rom_image *rom, bool cpm, const engine *e, uint64_t max_cycles, int machines, uint64_t skew) {
+    CPU *cpus[MAX_MACHINES];
+    uint64_t start[MAX_MACHINES];
+    for (int m = 0; m < machines; m++) {
+        cpus[m] = machine(rom, cpm);
+        run(cpus[m], m * skew, NULL);
+        start[m] = cpus[m]->cycles;
+    }
+    if (cpm) memset(emu_cp_m_os_output, 0, sizeof(emu_cp_m_os_output));
+
+    lanes *groups[MAX_MACHINES / LANES];
+    const int num_groups = e->lanes ? (machines + LANES - 1) / LANES : 0;
+    for (int g = 0; g < num_groups; g++) {
+        const int n = machines - g * LANES < LANES ? machines - g * LANES : LANES;
+        groups[g] = lanes_open(&cpus[g * LANES], n);
+        if (groups[g] == NULL) {
+            printf("lanes_open: not supported on this host\n");
+            exit(1);
+        }
+    }
+
+    result res = {0};
+    for (uint64_t frame = 0; frame < max_cycles; frame += CYCLES_PER_FRAME) {
+        bool running = false;
+        for (int m = 0; m < machines; m++) {
+            running |= !cpus[m]->exit;
+        }
+        if (!running) break;
+
+        for (int half = 0; half < 2; half++) {
+            for (int m = 0; m < machines && !cpm; m++) {
+                interrupt(cpus[m], 60);
+            }
+            for (int g = 0; g < num_groups; g++) {
+                lanes_run(groups[g], CYCLES_PER_FRAME / 2);
+                res.calls++;
+            }
+            for (int m = 0; m < machines && !e->lanes; m++) {
+                CPU *cpu = cpus[m];
+                if (e->run) {
+                    e->run(cpu, CYCLES_PER_FRAME / 2);
+                    continue;
+                }
+                const uint64_t end = cpu->cycles + CYCLES_PER_FRAME / 2;
+                while (cpu->cycles < end && !cpu->exit) {
+                    exec(cpu);
+                    res.instructions++;
+                }
+            }
+        }
+    }
+
+    for (int g = 0; g < num_groups; g++) {
+        res.groups += groups[g]->groups;
+        res.vector_ops += groups[g]->vector_ops;
+        res.scalar_ops += groups[g]->scalar_ops;
+        res.diverged += groups[g]->diverged;
+        lanes_close(groups[g]);
+    }
+    for (int m = 0; m < machines; m++) {
+        res.cycles += cpus[m]->cycles - start[m];
+        free_cpu(cpus[m]);
+    }
+    return res;
+}
+
+int main(int argc, char **argv) {
+    uint64_t max_cycles = DEFAULT_CYCLES;
+    int runs = DEFAULT_RUNS;
+    int machines = 1;
+    uint64_t skew = 0;
+    const engine *e = &engines[0];
+
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-c") == 0) {
+            max_cycles = strtoull(argv[arg + 1], NULL, 10);
+        } else if (strcmp(argv[arg], "-r") == 0) {
+            runs = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-m") == 0) {
+            machines = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            skew = strtoull(argv[arg + 1], NULL, 10);
+        } else if (strcmp(argv[arg], "-e") == 0) {
+            e = NULL;
+            for (size_t i = 0; i < NUM_ENGINES; i++) {
+                if (strcmp(argv[arg + 1], engines[i].name) == 0) e = &engines[i];
+            }
+            if (e == NULL) {
+                printf("unknown engine: %s\n", argv[arg + 1]);
+                exit(1);
+            }
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+
+    const char *path = DEFAULT_ROM;
+    uint16_t base_addr = 0x0100;
+    emu_cp_m_os = true;
+    if (argc - arg == 3) {
+        path = argv[arg];
+        base_addr = strtol(argv[arg + 1], NULL, 16);
+        emu_cp_m_os = atoi(argv[arg + 2]);
+    } else if (argc != arg || runs < 1 || machines < 1 || machines > MAX_MACHINES) {
+        printf("usage: %s [-e exec|run|lanes|aot] [-c cycles] [-r runs] [-m machines] [-s skew] "
+            "[rom $base_addr emu_cpm_os:1|0]\n", argv[0]);
+        exit(1);
+    }
+
+    rom_image *rom = rom_open(path, base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", path);
+        exit(1);
+    }
+
+    double best = 0;
+    result res = {0};
+    for (int i = 0; i < runs; i++) {
+        const double start = now_seconds();
+        res = bench(rom, emu_cp_m_os, e, max_cycles, machines, skew);
+        const double elapsed = now_seconds() - start;
+        if (i == 0 || elapsed < best) best = elapsed;
+    }
+    rom_close(rom);
+
+    printf("%s (%s", path, e->name);
+    if (machines > 1) {
+        printf(" x%d", machines);
+    }
+    printf("): %llu cycles, best of %d: %.3fs, %.1f MHz", (unsigned long long) res.cycles, runs, best, res.cycles / best / 1e6);
+    if (res.instructions) {
+        printf(", %.1f Minstr/s", res.instructions / best / 1e6);
+    }
+    if (res.groups) {
+        const uint64_t ops = res.vector_ops + res.scalar_ops;
+        printf(", %.2f lanes/group, %.1f%% vector, %.1f%% diverged", (double) ops / res.groups,
+            100.0 * res.vector_ops / ops, 100.0 * res.diverged / res.calls);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "cpu_plugin.h"
+#include "rom.h"
+
+// Runs the CP/M diag roms in diag/ headless and writes one csv row per rom
+// (pass/fail, wall time, instructions/sec) to the results file.
+//
+// usage: emu-diag [-o results.csv] [-d romdir] [rom...]
+
+#define DEFAULT_RESULTS "diag_results.csv"
+#define DEFAULT_ROM_DIR "diag"
+
+// CP/M loads programs here, the zero page holds the BDOS vector
+#define CPM_TPA 0x0100
+// programs like 8080EXER do "lhld 6; sphl" to find the top of memory
+#define CPM_BDOS_TOP 0xf000
+
+typedef struct {
+    const char *file;
+    uint32_t crc32; // of the image, catches a corrupt/replaced rom
+    const char *pass; // must be in the CP/M output
+    const char *fail; // must not be in the CP/M output
+    uint64_t max_instructions; // guards against the cpu spinning forever
+} diag_rom;
+
+static const diag_rom roms[] = {
+    { "TEST.COM",     0xce4cfbfa, "CPU IS OPERATIONAL", "CPU HAS FAILED", 10000000ULL },
+    { "cpudiag.bin",  0x298d02dc, "CPU IS OPERATIONAL", "CPU HAS FAILED", 10000000ULL },
+    { "8080PRE.COM",  0x295caf8f, "Preliminary tests complete", "ERROR", 10000000ULL },
+    { "CPUTEST.COM",  0xb4207450, "CPU TESTS OK", "CPU FAILED", 1000000000ULL },
+    { "8080EXER.COM", 0xd35c5a2f, "Tests complete", "ERROR", 20000000000ULL },
+    { "8080EX1.COM",  0x0d03c052, "Tests complete", "ERROR", 20000000000ULL },
+};
+#define NUM_ROMS (sizeof(roms) / sizeof(roms[0]))
+
+typedef struct {
+    bool passed;
+    const char *reason;
+    uint32_t crc32;
+    uint64_t instructions;
+    double wall_seconds;
+} diag_result;
+
+double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+diag_result run_rom(const diag_rom *rom, const char *dir) {
+    diag_result res = { .passed = false, .reason = "" };
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, rom->file);
+
+    rom_image *image = rom_open(path, CPM_TPA);
+    if (image == NULL) {
+        res.reason = "unreadable rom";
+        return res;
+    }
+
+    res.crc32 = image->crc32;
+    if (res.crc32 != rom->crc32) {
+        rom_close(image);
+        res.reason = "rom crc mismatch";
+        return res;
+    }
+
+    CPU *cpu = init(CPM_TPA);
+    rom_load(cpu, image);
+    rom_close(image);
+    cpu->mem[5] = 0xc9; // RET, BDOS calls are trapped by cpu_plugin.c anyway
+    cpu->mem[6] = CPM_BDOS_TOP & 0xff;
+    cpu->mem[7] = CPM_BDOS_TOP >> 8;
+
+    emu_cp_m_os = true;
+    memset(emu_cp_m_os_output, 0, sizeof(emu_cp_m_os_output));
+
+    const double start = now_seconds();
+    uint64_t instructions = 0;
+    while (!cpu->exit && instructions < rom->max_instructions) {
+        exec(cpu);
+        instructions++;
+    }
+    res.wall_seconds = now_seconds() - start;
+    res.instructions = instructions;
+    free_cpu(cpu);
+
+    if (instructions >= rom->max_instructions) {
+        res.reason = "instruction limit reached";
+    } else if (strstr(emu_cp_m_os_output, rom->fail) != NULL) {
+        res.reason = "failure reported";
+    } else if (strstr(emu_cp_m_os_output, rom->pass) == NULL) {
+        res.reason = "pass string missing";
+    } else {
+        res.passed = true;
+    }
+
+    return res;
+}
+
+bool selected(const diag_rom *rom, int argc, char **argv, int first) {
+    if (first >= argc) {
+        return true;
+    }
+    for (int i = first; i < argc; i++) {
+        if (strcasecmp(argv[i], rom->file) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int main(int argc, char **argv) {
+    const char *results_path = DEFAULT_RESULTS;
+    const char *dir = DEFAULT_ROM_DIR;
+
+    int first = 1;
+    while (first + 1 < argc && argv[first][0] == '-') {
+        if (strcmp(argv[first], "-o") == 0) {
+            results_path = argv[first + 1];
+        } else if (strcmp(argv[first], "-d") == 0) {
+            dir = argv[first + 1];
+        } else {
+            break;
+        }
+        first += 2;
+    }
+
+    FILE *out = fopen(results_path, "w");
+    if (out == NULL) {
+        printf("fopen %s\n", results_path);
+        exit(1);
+    }
+    fprintf(out, "rom,status,reason,crc32,instructions,wall_seconds,instructions_per_sec\n");
+
+    int failures = 0;
+    for (size_t i = 0; i < NUM_ROMS; i++) {
+        const diag_rom *rom = &roms[i];
+        if (!selected(rom, argc, argv, first)) {
+            continue;
+        }
+
+        printf("%-14s ", rom->file);
+        fflush(stdout);
+
+        const diag_result res = run_rom(rom, dir);
+        const double ips = res.wall_seconds > 0 ? res.instructions / res.wall_seconds : 0;
+        if (!res.passed) {
+            failures++;
+        }
+
+        printf("%s %12llu instr %8.3fs %8.2f Minstr/s %s\n", res.passed ? "PASS" : "FAIL",
+            (unsigned long long) res.instructions, res.wall_seconds, ips / 1e6, res.reason);
+        fprintf(out, "%s,%s,%s,%08x,%llu,%.6f,%.0f\n", rom->file, res.passed ? "pass" : "fail",
+            res.reason, res.crc32, (unsigned long long) res.instructions, res.wall_seconds, ips);
+
+        if (!res.passed && emu_cp_m_os_output[0] != '\0') {
+            printf("CP/M OUT: %s\n", emu_cp_m_os_output);
+        }
+    }
+
+    fclose(out);
+    printf("results written to %s\n", results_path);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "disass.h"
+#include "rom.h"
+
+// Whole rom listings. Linear by default, -r follows the code from the
+// entry points (-e, or the reset and interrupt vectors like emu-analyze)
+// and lists what it can't reach as data. -l puts labels on branch
+// targets, -a lists all 64K with the rom loaded at its base.
+//
+// usage: emu-disass [-r] [-l] [-a] [-e entry]... rom $base_addr
+
+#define MAX_ENTRIES 16
+
+static uint8_t mem[MEM_SIZE + 2];
+
+int main(int argc, char **argv) {
+    uint16_t entries[MAX_ENTRIES];
+    disass_range_options opt = { .mode = DISASS_LINEAR, .entries = entries };
+    bool all = false;
+
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-r") == 0) {
+            opt.mode = DISASS_RECURSIVE;
+        } else if (strcmp(argv[arg], "-l") == 0) {
+            opt.labels = true;
+        } else if (strcmp(argv[arg], "-a") == 0) {
+            all = true;
+        } else if (strcmp(argv[arg], "-e") == 0 && arg + 1 < argc && opt.num_entries < MAX_ENTRIES) {
+            entries[opt.num_entries++] = strtol(argv[++arg], NULL, 16);
+        } else {
+            break;
+        }
+    }
+    if (arg + 2 != argc) {
+        printf("usage: %s [-r] [-l] [-a] [-e entry]... rom $base_addr\n", argv[0]);
+        exit(1);
+    }
+
+    const uint16_t base_addr = strtol(argv[arg + 1], NULL, 16);
+    rom_image *rom = rom_open(argv[arg], base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[arg]);
+        exit(1);
+    }
+    const size_t size = rom->size < MEM_SIZE - base_addr ? rom->size : MEM_SIZE - base_addr;
+    memcpy(&mem[base_addr], rom->data, size);
+
+    if (opt.num_entries == 0 && base_addr == 0) {
+        entries[opt.num_entries++] = 0x0000;
+        entries[opt.num_entries++] = 0x0008;
+        entries[opt.num_entries++] = 0x0010;
+    } else if (opt.num_entries == 0) {
+        entries[opt.num_entries++] = base_addr;
+    }
+
+    opt.start = all ? 0 : base_addr;
+    opt.end = all ? MEM_SIZE : base_addr + size;
+    const size_t instructions = disass_range(stdout, mem, &opt);
+    fprintf(stderr, "%zu instructions, %u bytes\n", instructions, opt.end - opt.start);
+
+    rom_close(rom);
+    return 0;
+}
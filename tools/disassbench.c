@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cpu.h"
+#include "disass.h"
+#include "opcodes.h"
+
+// Disassembly throughput over 64K of random bytes: disass() as it was,
+// sprintf into temporaries one call per instruction, against
+// disass_line() and disass_range() streaming the whole space to
+// /dev/null, linear and recursive with labels. Every line disass_line()
+// writes is checked against the sprintf one first.
+//
+// usage: emu-disassbench [-p passes]
+
+#define DEFAULT_PASSES 20
+
+static uint8_t mem[MEM_SIZE + 2];
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// disass() before disass_line()
+static int disass_sprintf(char *output, const uint8_t *mem, const int pc) {
+    const uint8_t *opcode = &mem[pc];
+    const op_info *info = &opcodes[opcode[0]];
+
+    char mnem[DISASS_OP_SIZE];
+    switch (info->length) {
+        case 1: snprintf(mnem, sizeof(mnem), info->mnemonic, 0); break;
+        case 2: snprintf(mnem, sizeof(mnem), info->mnemonic, opcode[1]); break;
+        case 3: snprintf(mnem, sizeof(mnem), info->mnemonic, (opcode[2] << 8) | opcode[1]); break;
+    }
+
+    char raw_header[DISASS_OP_SIZE];
+    switch (info->length) {
+        case 1: sprintf(raw_header, "%04x %02x    \t", pc, opcode[0]); break;
+        case 2: sprintf(raw_header, "%04x %02x %02x  \t", pc, opcode[0], opcode[1]); break;
+        case 3: sprintf(raw_header, "%04x %02x %02x %02x\t", pc, opcode[0], opcode[1], opcode[2]); break;
+    }
+
+    strcat(raw_header, mnem);
+    memcpy(output, raw_header, DISASS_OP_SIZE);
+    return info->length;
+}
+
+static void report(const char *name, const double seconds, const int passes, const size_t instructions,
+        const double base) {
+    printf("%-26s %7.2f ms/64K", name, seconds / passes * 1e3);
+    if (instructions) {
+        printf(" %8.1f ns/instruction", seconds / instructions * 1e9);
+    } else {
+        printf(" %23s", "");
+    }
+    if (base > 0) {
+        printf("  %5.1fx", base / seconds);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    int passes = DEFAULT_PASSES;
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc) {
+            passes = atoi(argv[++arg]);
+        } else {
+            printf("usage: %s [-p passes]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    srand(8080);
+    for (int i = 0; i < MEM_SIZE; i++) {
+        mem[i] = rand();
+    }
+
+    char a[DISASS_OP_SIZE], b[DISASS_OP_SIZE];
+    size_t instructions = 0;
+    for (uint32_t pc = 0; pc < MEM_SIZE; ) {
+        int size;
+        b[disass_line(b, mem, pc, &size)] = '\0';
+        disass_sprintf(a, mem, pc);
+        if (strcmp(a, b) != 0) {
+            printf("mismatch at %04x:\n  sprintf: %s\n  line:    %s\n", pc, a, b);
+            exit(1);
+        }
+        pc += size;
+        instructions++;
+    }
+    const size_t total = instructions * passes;
+
+    double start = now_seconds();
+    for (int p = 0; p < passes; p++) {
+        for (uint32_t pc = 0; pc < MEM_SIZE; ) {
+            pc += disass_sprintf(a, mem, pc);
+        }
+    }
+    const double base = now_seconds() - start;
+    report("sprintf, per call", base, passes, total, 0);
+
+    start = now_seconds();
+    for (int p = 0; p < passes; p++) {
+        for (uint32_t pc = 0; pc < MEM_SIZE; ) {
+            pc += disass(a, mem, pc);
+        }
+    }
+    report("disass(), per call", now_seconds() - start, passes, total, base);
+
+    FILE *null = fopen("/dev/null", "w");
+    const struct { const char *name; disass_range_options opt; } ranges[] = {
+        { "disass_range() linear", { .mode = DISASS_LINEAR, .start = 0, .end = MEM_SIZE } },
+        { "disass_range() linear -l", { .mode = DISASS_LINEAR, .start = 0, .end = MEM_SIZE, .labels = true } },
+        { "disass_range() recursive", { .mode = DISASS_RECURSIVE, .start = 0, .end = MEM_SIZE,
+            .entries = (uint16_t[]) { 0x0000 }, .num_entries = 1, .labels = true } },
+    };
+    for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        size_t listed = 0;
+        start = now_seconds();
+        for (int p = 0; p < passes; p++) {
+            listed += disass_range(null, mem, &ranges[r].opt);
+        }
+        // random bytes are mostly data to the recursive one, per 64K only
+        report(ranges[r].name, now_seconds() - start, passes,
+            ranges[r].opt.mode == DISASS_LINEAR ? listed : 0, base);
+    }
+    fclose(null);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "env.h"
+#include "rom.h"
+
+// Batched environment throughput: steps n machines with random actions,
+// resets the ones whose game ended, and reports steps (one machine, one
+// step of -f frames) per second overall and per thread. The observations
+// are in env->ram the whole time, a consumer would map the same array.
+//
+// usage: emu-env [-n machines] [-t threads] [-f frames] [-s steps] rom
+
+#define DEFAULT_MACHINES 16
+#define DEFAULT_FRAMES 4
+#define DEFAULT_STEPS 1000
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    int n = DEFAULT_MACHINES, threads = 1, frames = DEFAULT_FRAMES, steps = DEFAULT_STEPS;
+
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        const int v = atoi(argv[arg + 1]);
+        if (strcmp(argv[arg], "-n") == 0) {
+            n = v;
+        } else if (strcmp(argv[arg], "-t") == 0) {
+            threads = v;
+        } else if (strcmp(argv[arg], "-f") == 0) {
+            frames = v;
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            steps = v;
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+
+    if (argc - arg != 1 || n < 1 || frames < 1 || steps < 1) {
+        printf("usage: %s [-n machines] [-t threads] [-f frames] [-s steps] rom\n", argv[0]);
+        exit(1);
+    }
+
+    rom_image *rom = rom_open(argv[arg], 0);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[arg]);
+        exit(1);
+    }
+
+    env *e = env_open(rom, n, -1, 0, threads);
+    if (e == NULL) {
+        printf("env_open: %d machines, %d threads\n", n, threads);
+        exit(1);
+    }
+
+    static const uint8_t moves[] = { 0, ENV_LEFT, ENV_RIGHT, ENV_FIRE, ENV_LEFT | ENV_FIRE, ENV_RIGHT | ENV_FIRE };
+    uint8_t *actions = calloc(n, 1);
+    uint32_t seed = 0x2400;
+    uint64_t games = 0, score = 0;
+
+    const double start = now_seconds();
+    for (int s = 0; s < steps; s++) {
+        for (int i = 0; i < n; i++) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            // coin and start until a game runs, then move and shoot
+            actions[i] = e->infos[i].playing ? moves[seed % sizeof(moves)] : (s & 1 ? ENV_COIN : ENV_START);
+        }
+        env_step(e, actions, frames);
+        for (int i = 0; i < n; i++) {
+            if (!e->infos[i].done) continue;
+            games++;
+            score += e->infos[i].score;
+            env_reset(e, i);
+        }
+    }
+    const double elapsed = now_seconds() - start;
+
+    const double per_second = (double) n * steps / elapsed;
+    printf("%s: %d machines, %d threads, %d frames/step: %.0f steps/s, %.0f steps/s/thread, %.0f frames/s",
+        argv[arg], n, e->threads, frames, per_second, per_second / e->threads, per_second * frames);
+    if (games) {
+        printf(", %llu games, avg score %.1f", (unsigned long long) games, (double) score / games);
+    }
+    printf("\n");
+
+    env_close(e);
+    free(actions);
+    rom_close(rom);
+    return 0;
+}
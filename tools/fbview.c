@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "fbring.h"
+
+// Reference consumer for the emulator's --export ring: follows the newest
+// frame and writes each one it gets as a 224x256 PBM image. The output
+// path is a printf pattern taking the frame number (frame%05llu.pbm), a
+// plain path is just overwritten. Frames the producer published while we
+// were busy are counted as skipped, slots it rewrote under us as torn.
+//
+// usage: emu-fbview [-n frames] [-o pattern] name
+
+#define DEFAULT_FRAMES 60
+#define DEFAULT_PATTERN "frame.pbm"
+#define IDLE_TIMEOUT_MS 2000
+
+#define WIDTH 224
+#define HEIGHT 256
+
+static void sleep_ms(long ms) {
+    const struct timespec ts = { ms / 1000, (ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+// VRAM is the rotated screen: byte x * 32 + y / 8 holds 8 pixels of
+// column x, bottom up, bit 0 first
+static void to_pbm(const uint8_t *vram, uint8_t *pbm) {
+    memset(pbm, 0, WIDTH / 8 * HEIGHT);
+    for (int x = 0; x < WIDTH; x++) {
+        for (int y = 0; y < HEIGHT; y++) {
+            const int v = HEIGHT - 1 - y;
+            if (vram[x * (HEIGHT / 8) + v / 8] & (1 << (v & 7))) {
+                pbm[y * (WIDTH / 8) + x / 8] |= 0x80 >> (x & 7);
+            }
+        }
+    }
+}
+
+static bool write_pbm(const char *path, const uint8_t *pbm) {
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) return false;
+    fprintf(f, "P4\n%d %d\n", WIDTH, HEIGHT);
+    const bool ok = fwrite(pbm, WIDTH / 8 * HEIGHT, 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+int main(int argc, char **argv) {
+    uint64_t max_frames = DEFAULT_FRAMES;
+    const char *pattern = DEFAULT_PATTERN;
+
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-n") == 0) {
+            max_frames = strtoull(argv[arg + 1], NULL, 10);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            pattern = argv[arg + 1];
+        } else {
+            break;
+        }
+        arg += 2;
+    }
+    if (argc - arg != 1) {
+        printf("usage: %s [-n frames] [-o pattern] name\n", argv[0]);
+        exit(1);
+    }
+
+    const fbring *r = NULL;
+    for (int waited = 0; r == NULL; waited++) {
+        r = fbring_attach(argv[arg]);
+        if (r == NULL && waited * 10 > IDLE_TIMEOUT_MS) {
+            printf("fbring_attach %s\n", argv[arg]);
+            exit(1);
+        }
+        if (r == NULL) sleep_ms(10);
+    }
+
+    static uint8_t pbm[WIDTH / 8 * HEIGHT];
+    uint64_t written = 0, skipped = 0, torn = 0;
+    uint64_t last = fbring_frames(r); // next frame we want, starting with the newest
+    if (last > 0) last--;
+    int idle = 0;
+    while (written < max_frames && idle < IDLE_TIMEOUT_MS) {
+        const uint64_t n = fbring_frames(r);
+        if (n <= last) {
+            sleep_ms(1);
+            idle++;
+            continue;
+        }
+        idle = 0;
+
+        const fbring_slot *s = &r->slot[(n - 1) % FBRING_SLOTS];
+        const uint64_t seq = fbring_begin(s);
+        const uint64_t frame = s->frame;
+        to_pbm(s->vram, pbm);
+        if (!fbring_end(s, seq) || frame != n - 1) {
+            torn++;
+            continue;
+        }
+
+        skipped += frame - last;
+        last = frame + 1;
+
+        char path[1024];
+        snprintf(path, sizeof(path), pattern, (unsigned long long) frame);
+        if (!write_pbm(path, pbm)) {
+            printf("write %s\n", path);
+            exit(1);
+        }
+        written++;
+    }
+
+    printf("%s: %llu frames written, %llu skipped, %llu torn reads retried\n", argv[arg],
+        (unsigned long long) written, (unsigned long long) skipped, (unsigned long long) torn);
+    fbring_detach(r);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "framehash.h"
+
+// Checks a run's frame hash log (emu --hashes) against a golden one.
+// Prints the first frame that differs and how many do, exits 1 on any
+// difference, frame count included, so it can gate CI.
+//
+// usage: emu-framecmp golden.log run.log
+
+int main(int argc, char **argv) {
+    if (argc != 3) {
+        printf("usage: %s golden.log run.log\n", argv[0]);
+        exit(2);
+    }
+
+    uint64_t golden_frames, run_frames;
+    uint64_t *golden = framehash_load(argv[1], &golden_frames);
+    uint64_t *run = framehash_load(argv[2], &run_frames);
+    if (golden == NULL || run == NULL) {
+        printf("framehash_load %s\n", golden == NULL ? argv[1] : argv[2]);
+        exit(2);
+    }
+
+    const uint64_t frames = golden_frames < run_frames ? golden_frames : run_frames;
+    uint64_t first = frames, mismatches = 0;
+    for (uint64_t i = 0; i < frames; i++) {
+        if (golden[i] == run[i]) continue;
+        if (mismatches++ == 0) first = i;
+    }
+
+    int status = 0;
+    if (mismatches) {
+        printf("frame %llu: %016llx, golden %016llx (%llu of %llu frames differ)\n", (unsigned long long) first,
+            (unsigned long long) run[first], (unsigned long long) golden[first],
+            (unsigned long long) mismatches, (unsigned long long) frames);
+        status = 1;
+    }
+    if (golden_frames != run_frames) {
+        printf("%llu frames, golden has %llu\n", (unsigned long long) run_frames, (unsigned long long) golden_frames);
+        status = 1;
+    }
+    if (status == 0) {
+        printf("%llu frames match\n", (unsigned long long) frames);
+    }
+
+    free(golden);
+    free(run);
+    return status;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "screen.h"
+
+// Frame conversion throughput: the per pixel loop render_sdl() used to
+// run (1x, white only, SDL stretched it to the window) against
+// screen_render() with and without the gel overlay, at 1x and at the 2x
+// the 800x600 window gets. The VRAM is random, about half the pixels lit,
+// so the old loop's branch is as unpredictable as it gets; a real frame
+// is mostly black and kinder to it.
+//
+// usage: emu-gfxbench [-f frames]
+
+#define DEFAULT_FRAMES 20000
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// gfx.c's loop before screen.c, a row up so it stays inside pixels
+static void render_loop(const uint8_t *buffer, uint32_t *pixels) {
+    memset(pixels, 0, SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint32_t));
+    int vram_index = 0;
+    for (int columns = 0; columns < SCREEN_WIDTH; columns++) {
+        for (int row = SCREEN_HEIGHT - 1; row > 0; row -= 8) {
+            for (int j = 0; j < 8; j++) {
+                int idx = (row - j) * SCREEN_WIDTH + columns;
+                if (buffer[vram_index] & 1 << j) {
+                    pixels[idx] = 0xFFFFFF;
+                } else {
+                    pixels[idx] = 0x000000;
+                }
+            }
+            vram_index++;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int frames = DEFAULT_FRAMES;
+    for (int arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc) {
+            frames = atoi(argv[++arg]);
+        } else {
+            printf("usage: %s [-f frames]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    uint8_t vram[SCREEN_VRAM_SIZE];
+    srand(8080);
+    for (int i = 0; i < SCREEN_VRAM_SIZE; i++) {
+        vram[i] = rand();
+    }
+    uint32_t *pixels = malloc(SCREEN_WIDTH * 2 * SCREEN_HEIGHT * 2 * sizeof(uint32_t));
+
+    double start = now_seconds();
+    for (int f = 0; f < frames; f++) {
+        vram[f % SCREEN_VRAM_SIZE]++;
+        render_loop(vram, pixels);
+    }
+    const double base = (now_seconds() - start) / frames;
+    printf("%-22s %8.1f us/frame\n", "loop 1x", base * 1e6);
+
+    const struct { int scale; bool overlay; } modes[] = { { 1, false }, { 1, true }, { 2, true } };
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        screen *s = screen_open(modes[m].scale, modes[m].overlay);
+        start = now_seconds();
+        for (int f = 0; f < frames; f++) {
+            vram[f % SCREEN_VRAM_SIZE]++;
+            screen_render(s, vram, pixels);
+        }
+        const double t = (now_seconds() - start) / frames;
+        char name[32];
+        snprintf(name, sizeof(name), "lut %dx%s", modes[m].scale, modes[m].overlay ? " overlay" : "");
+        printf("%-22s %8.1f us/frame, %.2fx\n", name, t * 1e6, base / t);
+        screen_close(s);
+    }
+
+    free(pixels);
+    return 0;
+}
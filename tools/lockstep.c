@@ -0,0 +1,423 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "cpu_plugin.h"
+#include "interrupts.h"
+#include "disass.h"
+#include "rom.h"
+#include "lanes.h"
+#ifdef AOT
+#include "aot.h"
+#endif
+
+// Runs two execution engines on cloned machines and checks that they agree
+// after every step. Memory is compared through an incremental hash: each
+// step only rehashes the handful of bytes an 8080 instruction can write
+// (HL, BC, DE, around SP and the immediate address), and a full rehash
+// every few million steps catches writes outside that set. Each full rehash
+// that matches is a checkpoint, a divergence is bisected from the last one
+// by replaying, so the step reported is the first one the machines differ
+// after, not wherever the rehash happened to notice it.
+//
+// Engines that can't stop after one instruction (lanes, aot, which only
+// check the budget between blocks) are compared after every -B cycle
+// budget instead. Each runs its budget and whichever machine stopped
+// earlier catches up through exec() to where the other one did, then
+// registers and full memory hashes are compared. -n counts budgets then.
+// emu-lockstep-aot (make emu-lockstep-aot AOT_ROM=...) has the aot engine.
+//
+// usage: emu-lockstep [-a engine] [-b engine] [-n max_steps] [-c check_every] [-B budget]
+//                     [-i interrupt_cycles] [rom] [$base_addr] [emu_cpm_os:1|0]
+
+#define DEFAULT_MAX_STEPS 100000000ULL
+#define DEFAULT_BUDGET 10000 // cycles, when an engine can't step
+#define MAX_CATCH_UP 1000 // instructions, machines that don't line up by then have diverged
+#define FULL_REHASH_STEPS (1 << 22)
+#define HISTORY 16 // instructions shown before the divergence
+#define MAX_MEM_DIFFS 8
+
+typedef struct {
+    const char *name;
+    void (*step)(CPU *cpu); // one instruction, NULL when the engine can't
+    void (*run)(CPU *cpu, uint64_t cycles); // until the budget is spent or the machine exits
+} engine;
+
+static void exec_budget(CPU *cpu, const uint64_t cycles) {
+    const uint64_t end = cpu->cycles + cycles;
+    while (cpu->cycles < end && !cpu->exit) {
+        exec(cpu);
+    }
+}
+
+// run() always retires one instruction, a budget of 1 is exactly that
+static void run_step(CPU *cpu) {
+    run(cpu, 1, NULL);
+}
+
+static void run_budget(CPU *cpu, const uint64_t cycles) {
+    run(cpu, cycles, NULL);
+}
+
+// Every machine in a lane of its own, kept open between budgets
+static struct {
+    CPU *cpu;
+    lanes *l;
+} lane_of[2];
+
+static void lanes_budget(CPU *cpu, const uint64_t cycles) {
+    int i = 0;
+    while (lane_of[i].cpu != cpu && lane_of[i].cpu != NULL) i++;
+    if (lane_of[i].cpu == NULL) {
+        lane_of[i].l = lanes_open(&cpu, 1);
+        if (lane_of[i].l == NULL) {
+            printf("lanes_open: not supported on this host\n");
+            exit(1);
+        }
+        lane_of[i].cpu = cpu;
+    }
+    lanes_run(lane_of[i].l, cycles);
+}
+
+#ifdef AOT
+static void aot_budget(CPU *cpu, const uint64_t cycles) {
+    aot_run(cpu, cycles);
+}
+#endif
+
+static const engine engines[] = {
+    { "exec", exec, exec_budget },
+    { "run", run_step, run_budget },
+    { "lanes", NULL, lanes_budget },
+#ifdef AOT
+    { "aot", NULL, aot_budget },
+#endif
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// The only addresses a single instruction (or an injected RST) can write.
+#define MAX_WRITES 9
+typedef struct {
+    uint16_t addr[MAX_WRITES];
+    uint8_t before_a[MAX_WRITES];
+    uint8_t before_b[MAX_WRITES];
+    int n;
+} write_set;
+
+static inline uint64_t mix(const uint16_t addr, const uint8_t val) {
+    // splitmix64 finalizer
+    uint64_t z = (((uint64_t) addr << 8) | val) + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+uint64_t full_hash(const CPU *cpu) {
+    uint64_t h = 0;
+    for (uint32_t i = 0; i < MEM_SIZE; i++) {
+        h += mix(i, cpu->mem[i]);
+    }
+    return h;
+}
+
+static void add_addr(write_set *ws, const uint16_t addr) {
+    for (int i = 0; i < ws->n; i++) {
+        if (ws->addr[i] == addr) return;
+    }
+    ws->addr[ws->n++] = addr;
+}
+
+static void collect(write_set *ws, const CPU *a, const CPU *b) {
+    ws->n = 0;
+    const uint16_t imm = (a->mem[(uint16_t) (a->pc + 2)] << 8) | a->mem[(uint16_t) (a->pc + 1)];
+    add_addr(ws, a->HL);
+    add_addr(ws, a->BC);
+    add_addr(ws, a->DE);
+    add_addr(ws, a->sp - 2);
+    add_addr(ws, a->sp - 1);
+    add_addr(ws, a->sp);
+    add_addr(ws, a->sp + 1);
+    add_addr(ws, imm);
+    add_addr(ws, imm + 1);
+
+    for (int i = 0; i < ws->n; i++) {
+        ws->before_a[i] = a->mem[ws->addr[i]];
+        ws->before_b[i] = b->mem[ws->addr[i]];
+    }
+}
+
+static uint64_t rehash(uint64_t h, const write_set *ws, const uint8_t *before, const CPU *cpu) {
+    for (int i = 0; i < ws->n; i++) {
+        const uint16_t addr = ws->addr[i];
+        h += mix(addr, cpu->mem[addr]) - mix(addr, before[i]);
+    }
+    return h;
+}
+
+// The machines at the last full rehash that matched
+typedef struct {
+    CPU *a, *b;
+    uint64_t step;
+    uint64_t next_interrupt;
+    uint16_t history[HISTORY];
+} checkpoint;
+
+static void save_checkpoint(checkpoint *c, const CPU *a, const CPU *b, const uint64_t step,
+                            const uint64_t next_interrupt, const uint16_t *history) {
+    copy_cpu(c->a, a);
+    copy_cpu(c->b, b);
+    c->step = step;
+    c->next_interrupt = next_interrupt;
+    memcpy(c->history, history, sizeof(c->history));
+}
+
+// One step of both machines, or the interrupt due instead
+static void lockstep_step(const engine *ea, const engine *eb, CPU *a, CPU *b, const uint64_t interrupt_cycles,
+                          uint64_t *next_interrupt) {
+    if (interrupt_cycles && a->cycles >= *next_interrupt) {
+        interrupt(a, 60);
+        interrupt(b, 60);
+        *next_interrupt += interrupt_cycles;
+    } else {
+        ea->step(a);
+        eb->step(b);
+    }
+}
+
+bool regs_equal(const CPU *a, const CPU *b) {
+    return a->A == b->A
+        && *(const uint8_t*) &a->f == *(const uint8_t*) &b->f
+        && a->BC == b->BC && a->DE == b->DE && a->HL == b->HL
+        && a->sp == b->sp && a->pc == b->pc
+        && a->interrupts_disabled == b->interrupts_disabled
+        && a->exit == b->exit
+        && a->cycles == b->cycles
+        && memcmp(a->io_ports, b->io_ports, sizeof(a->io_ports)) == 0
+        && a->shift0 == b->shift0 && a->shift1 == b->shift1 && a->shift_offset == b->shift_offset
+        && a->interrupt_flag == b->interrupt_flag;
+}
+
+static bool states_equal(const CPU *a, const CPU *b) {
+    return regs_equal(a, b) && memcmp(a->mem, b->mem, MEM_SIZE) == 0;
+}
+
+// Into a and b: the checkpoint run to step, with the history up to it
+static void replay(const engine *ea, const engine *eb, CPU *a, CPU *b, const checkpoint *c, const uint64_t step,
+                   const uint64_t interrupt_cycles, uint16_t *history) {
+    copy_cpu(a, c->a);
+    copy_cpu(b, c->b);
+    memcpy(history, c->history, sizeof(c->history));
+    uint64_t next_interrupt = c->next_interrupt;
+    for (uint64_t i = c->step; i < step; i++) {
+        history[i % HISTORY] = a->pc;
+        lockstep_step(ea, eb, a, b, interrupt_cycles, &next_interrupt);
+    }
+}
+
+// The machines agree at the checkpoint and not after bad steps, leaves them
+// after the first step they differ after and returns it
+static uint64_t bisect(const engine *ea, const engine *eb, CPU *a, CPU *b, const checkpoint *c, uint64_t bad,
+                       const uint64_t interrupt_cycles, uint16_t *history) {
+    uint64_t good = c->step;
+    while (bad - good > 1) {
+        const uint64_t mid = good + (bad - good) / 2;
+        replay(ea, eb, a, b, c, mid, interrupt_cycles, history);
+        if (states_equal(a, b)) good = mid;
+        else bad = mid;
+    }
+    replay(ea, eb, a, b, c, bad, interrupt_cycles, history);
+    return bad;
+}
+
+void print_regs(const char *name, const CPU *cpu) {
+    printf("  %-8s PC=%04x SP=%04x A=%02x F=%02x BC=%04x DE=%04x HL=%04x cycles=%llu ie=%d exit=%d shift=%02x%02x>>%d\n",
+        name, cpu->pc, cpu->sp, cpu->A, *(const uint8_t*) &cpu->f, cpu->BC, cpu->DE, cpu->HL,
+        (unsigned long long) cpu->cycles, !cpu->interrupts_disabled, cpu->exit,
+        cpu->shift1, cpu->shift0, cpu->shift_offset);
+}
+
+void report(const engine *ea, const engine *eb, const CPU *a, const CPU *b, const char *unit,
+            uint64_t step, const uint16_t *history, uint64_t history_len) {
+    char line[DISASS_OP_SIZE];
+
+    printf("DIVERGENCE after %s %llu\n", unit, (unsigned long long) step);
+    print_regs(ea->name, a);
+    print_regs(eb->name, b);
+
+    int diffs = 0;
+    for (uint32_t i = 0; i < MEM_SIZE && diffs < MAX_MEM_DIFFS; i++) {
+        if (a->mem[i] != b->mem[i]) {
+            printf("  mem[%04x]: %s=%02x %s=%02x\n", i, ea->name, a->mem[i], eb->name, b->mem[i]);
+            diffs++;
+        }
+    }
+
+    if (history_len) {
+        printf("last instructions:\n");
+        const uint64_t n = history_len < HISTORY ? history_len : HISTORY;
+        for (uint64_t i = history_len - n; i < history_len; i++) {
+            disass(line, a->mem, history[i % HISTORY]);
+            printf("  %s%s\n", line, i == history_len - 1 ? "   <--" : "");
+        }
+    }
+    disass(line, a->mem, a->pc);
+    printf("next (%s): %s\n", ea->name, line);
+    disass(line, b->mem, b->pc);
+    printf("next (%s): %s\n", eb->name, line);
+}
+
+const engine* find_engine(const char *name) {
+    for (size_t i = 0; i < NUM_ENGINES; i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return &engines[i];
+        }
+    }
+    printf("unknown engine %s, available:", name);
+    for (size_t i = 0; i < NUM_ENGINES; i++) {
+        printf(" %s", engines[i].name);
+    }
+    printf("\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const engine *ea = &engines[0];
+    const engine *eb = &engines[0];
+    uint64_t max_steps = DEFAULT_MAX_STEPS;
+    uint64_t check_every = 1;
+    uint64_t interrupt_cycles = 0;
+    uint64_t budget = 0;
+
+    int arg = 1;
+    while (arg + 1 < argc && argv[arg][0] == '-') {
+        const char *opt = argv[arg];
+        const char *val = argv[arg + 1];
+        if (strcmp(opt, "-a") == 0) ea = find_engine(val);
+        else if (strcmp(opt, "-b") == 0) eb = find_engine(val);
+        else if (strcmp(opt, "-n") == 0) max_steps = strtoull(val, NULL, 10);
+        else if (strcmp(opt, "-c") == 0) check_every = strtoull(val, NULL, 10);
+        else if (strcmp(opt, "-i") == 0) interrupt_cycles = strtoull(val, NULL, 10);
+        else if (strcmp(opt, "-B") == 0) budget = strtoull(val, NULL, 10);
+        else break;
+        arg += 2;
+    }
+
+    if (argc - arg != 3 || check_every == 0) {
+        printf("usage: %s [-a engine] [-b engine] [-n max_steps] [-c check_every] [-B budget] [-i interrupt_cycles] "
+               "[rom] [$base_addr] [emu_cpm_os:1|0]\n", argv[0]);
+        exit(1);
+    }
+
+    const uint16_t base_addr = strtol(argv[arg + 1], NULL, 16);
+    emu_cp_m_os = atoi(argv[arg + 2]);
+    rom_image *rom = rom_open(argv[arg], base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[arg]);
+        exit(1);
+    }
+
+    CPU *a = init(base_addr);
+    rom_load(a, rom);
+    CPU *b = init(base_addr);
+    rom_load(b, rom);
+
+    if (budget == 0 && (ea->step == NULL || eb->step == NULL)) {
+        budget = DEFAULT_BUDGET;
+    }
+
+    uint64_t hash_a = full_hash(a);
+    uint64_t hash_b = hash_a;
+    uint64_t next_interrupt = interrupt_cycles;
+
+    uint16_t history[HISTORY] = { 0 };
+    checkpoint good = { .a = clone_cpu(a), .b = clone_cpu(b) };
+    save_checkpoint(&good, a, b, 0, next_interrupt, history);
+    write_set ws;
+    uint64_t step = 0;
+    bool diverged = false;
+
+    while (!budget && !a->exit && !b->exit && step < max_steps) {
+        collect(&ws, a, b);
+        history[step % HISTORY] = a->pc;
+        lockstep_step(ea, eb, a, b, interrupt_cycles, &next_interrupt);
+        step++;
+
+        hash_a = rehash(hash_a, &ws, ws.before_a, a);
+        hash_b = rehash(hash_b, &ws, ws.before_b, b);
+
+        if (step % FULL_REHASH_STEPS == 0) {
+            // catches writes the write set didn't predict
+            hash_a = full_hash(a);
+            hash_b = full_hash(b);
+            if (hash_a == hash_b && regs_equal(a, b)) {
+                save_checkpoint(&good, a, b, step, next_interrupt, history);
+            }
+        }
+
+        if (step % check_every == 0 && (hash_a != hash_b || !regs_equal(a, b))) {
+            diverged = true;
+            break;
+        }
+    }
+
+    uint64_t budget_start = 0;
+    while (budget && !a->exit && !b->exit && step < max_steps) {
+        uint64_t cycles = budget;
+        if (interrupt_cycles) {
+            if (a->cycles >= next_interrupt) {
+                interrupt(a, 60);
+                interrupt(b, 60);
+                next_interrupt += interrupt_cycles;
+            }
+            // stop at the next interrupt, or close after it when an engine overshoots
+            if (next_interrupt > a->cycles && next_interrupt - a->cycles < cycles) {
+                cycles = next_interrupt - a->cycles;
+            }
+        }
+
+        budget_start = a->cycles;
+        ea->run(a, cycles);
+        eb->run(b, cycles);
+        for (int i = 0; i < MAX_CATCH_UP && a->cycles != b->cycles && !a->exit && !b->exit; i++) {
+            exec(a->cycles < b->cycles ? a : b);
+        }
+        step++;
+
+        if (step % check_every == 0 && (full_hash(a) != full_hash(b) || !regs_equal(a, b))) {
+            diverged = true;
+            break;
+        }
+    }
+
+    // final full comparison, covers the steps between checks as well
+    if (!diverged && (full_hash(a) != full_hash(b) || !regs_equal(a, b))) {
+        diverged = true;
+    }
+
+    if (diverged && budget) {
+        printf("in the budget of %llu cycles from cycle %llu\n", (unsigned long long) budget,
+            (unsigned long long) budget_start);
+        report(ea, eb, a, b, "budget", step, history, 0);
+    } else if (diverged) {
+        step = bisect(ea, eb, a, b, &good, step, interrupt_cycles, history);
+        report(ea, eb, a, b, "step", step, history, step);
+    } else {
+        printf("%s and %s agree after %llu %s (%llu cycles)\n", ea->name, eb->name,
+            (unsigned long long) step, budget ? "budgets" : "steps", (unsigned long long) a->cycles);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        if (lane_of[i].l) {
+            lanes_close(lane_of[i].l);
+        }
+    }
+    free_cpu(good.a);
+    free_cpu(good.b);
+    free_cpu(a);
+    free_cpu(b);
+    rom_close(rom);
+    return diverged ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "disass.h"
+#include "rom.h"
+#include "blockindex.h"
+
+// Static recompiler: writes the basic blocks of a rom's block index
+// (emu-analyze, see blockindex.h) out as a C file implementing aot.h. The
+// index is what says where the code is, entry points and traces go to
+// emu-analyze.
+//
+// usage: emu-recomp rom $base_addr index.blk out.c
+
+static uint8_t mem[MEM_SIZE + 2];
+
+static void emit_block(FILE *out, const block_entry *b, int *instructions, int *bytes) {
+    const uint16_t start = b->start, end = b->start + b->length;
+
+    fprintf(out, "static bool block_%04x(CPU* cpu) {\n", start);
+    fprintf(out, "    static const uint8_t code[%d] = {", end - start);
+    for (uint16_t a = start; a != end; a++) {
+        fprintf(out, "%s0x%02x", a == start ? " " : ", ", mem[a]);
+    }
+    fprintf(out, " };\n");
+    fprintf(out, "    if (memcmp(&cpu->mem[0x%04x], code, sizeof(code)) != 0) return false;\n", start);
+
+    for (uint16_t addr = start; addr != end; ) {
+        char line[DISASS_OP_SIZE];
+        const int size = disass(line, mem, addr);
+        for (char *c = line; *c; c++) {
+            if (*c == '\t') *c = ' ';
+        }
+        fprintf(out, "    exec_op(cpu, 0x%02x, 0x%02x, 0x%02x); // %s\n", mem[addr], mem[addr + 2], mem[addr + 1], line);
+        addr += size;
+        (*instructions)++;
+    }
+    fprintf(out, "    return true;\n}\n\n");
+    *bytes += end - start;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 5) {
+        printf("usage: %s rom $base_addr index.blk out.c\n", argv[0]);
+        exit(1);
+    }
+
+    const uint16_t base_addr = strtol(argv[2], NULL, 16);
+    rom_image *rom = rom_open(argv[1], base_addr);
+    if (rom == NULL) {
+        printf("rom_open %s\n", argv[1]);
+        exit(1);
+    }
+    block_index *idx = block_index_open(argv[3]);
+    if (idx == NULL) {
+        printf("block_index_open %s\n", argv[3]);
+        exit(1);
+    }
+    const block_index_header *h = idx->header;
+    if (h->rom_crc32 != rom->crc32 || h->base_addr != base_addr) {
+        printf("%s: an index of another rom (crc32 %08x, base_addr 0x%04x)\n", argv[3], h->rom_crc32, h->base_addr);
+        exit(1);
+    }
+    memcpy(&mem[base_addr], rom->data, h->rom_size);
+    const uint32_t rom_start = base_addr, rom_end = base_addr + h->rom_size;
+
+    FILE *out = fopen(argv[4], "w");
+    if (out == NULL) {
+        printf("fopen %s\n", argv[4]);
+        exit(1);
+    }
+
+    fprintf(out, "// Generated by emu-recomp from %s (crc32 %08x), don't edit.\n\n", argv[1], rom->crc32);
+    fprintf(out, "#include <string.h>\n\n#include \"cpu_ops.h\"\n#include \"aot.h\"\n\n");
+    fprintf(out, "const char aot_rom[] = \"%s\";\n", argv[1]);
+    fprintf(out, "const uint32_t aot_rom_crc32 = 0x%08x;\n", rom->crc32);
+    fprintf(out, "const uint16_t aot_base_addr = 0x%04x;\n\n", base_addr);
+
+    int instructions = 0, bytes = 0;
+    for (uint32_t i = 0; i < h->num_blocks; i++) {
+        emit_block(out, &idx->blocks[i], &instructions, &bytes);
+    }
+
+    fprintf(out, "static bool (*const blocks[0x%x])(CPU* cpu) = {\n", rom_end - rom_start);
+    for (uint32_t i = 0; i < h->num_blocks; i++) {
+        const uint16_t a = idx->blocks[i].start;
+        fprintf(out, "    [0x%04x] = block_%04x,\n", a - rom_start, a);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out,
+        "run_reason aot_run(CPU* cpu, const uint64_t cycles) {\n"
+        "    const uint64_t end = cpu->cycles + cycles;\n"
+        "    while (cpu->cycles < end && !cpu->exit) {\n"
+        "        const uint16_t offset = cpu->pc - 0x%04x;\n"
+        "        if (offset < sizeof(blocks) / sizeof(blocks[0]) && blocks[offset] && blocks[offset](cpu)) {\n"
+        "            continue;\n"
+        "        }\n"
+        "        exec(cpu);\n"
+        "    }\n"
+        "    return cpu->exit ? RUN_EXIT : RUN_BUDGET;\n"
+        "}\n", rom_start);
+    fclose(out);
+
+    printf("%s: %u blocks, %d instructions, %d of %zu bytes reached as code\n",
+        argv[4], h->num_blocks, instructions, bytes, rom->size);
+    block_index_close(idx);
+    rom_close(rom);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cpu.h"
+#include "cpu_plugin.h"
+#include "input.h"
+#include "keyframe.h"
+
+// Checks a run's keyframes (emu --keyframes) against a replay of it: each
+// segment between two keyframes is replayed from the first, with the input
+// recording (emu --record) picked up where the keyframe left it, and has to
+// end with the second one's hash. The segments don't depend on each other,
+// -j threads take them off a shared counter, each with its own machine and
+// its own cursor into the one queue of events.
+//
+// A mismatching segment is where the emulator isn't deterministic, or the
+// files aren't from the same run. The keyframes' own hashes are checked
+// too, a file damaged on disk shows up as that instead.
+//
+// CP/M runs are replayed on one thread, the BDOS prints into one buffer.
+//
+// usage: emu-replayverify [-j threads] keyframes.key [input.rec]
+
+#define MAX_THREADS 64
+
+typedef enum { SEGMENT_OK, SEGMENT_MISMATCH, SEGMENT_DAMAGED } segment_result;
+
+typedef struct {
+    uint64_t hash; // at the end of the replay
+    double seconds; // of the thread's CPU time
+    segment_result result;
+} segment;
+
+typedef struct {
+    const keyframe_file *kf;
+    const input *recording; // NULL when there was no input
+    segment *segments;
+    uint64_t num_segments;
+    uint64_t next; // the first segment nobody took yet
+} job;
+
+static double now_seconds(const clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void replay(CPU *cpu, const job *j, const uint64_t i) {
+    const keyframe *from = &j->kf->frames[i], *to = &j->kf->frames[i + 1];
+    segment *s = &j->segments[i];
+    const double start = now_seconds(CLOCK_THREAD_CPUTIME_ID);
+
+    keyframe_restore(cpu, from);
+    if (state_hash(cpu) != from->hash) {
+        s->result = SEGMENT_DAMAGED;
+        return;
+    }
+
+    // the events are shared and read only, the cursor is this thread's
+    input cursor;
+    if (j->recording) {
+        cursor = *j->recording;
+        cursor.record = NULL;
+        input_seek(&cursor, from->input_applied);
+        cpu->input = &cursor;
+    }
+    keyframe_run_frames(cpu, to->frame - from->frame);
+    cpu->input = NULL;
+
+    s->hash = state_hash(cpu);
+    s->result = s->hash == to->hash ? SEGMENT_OK : SEGMENT_MISMATCH;
+    s->seconds = now_seconds(CLOCK_THREAD_CPUTIME_ID) - start;
+}
+
+static void* worker(void *arg) {
+    job *j = arg;
+    CPU *cpu = init(j->kf->header->base_addr);
+    for (;;) {
+        const uint64_t i = __atomic_fetch_add(&j->next, 1, __ATOMIC_RELAXED);
+        if (i >= j->num_segments) break;
+        replay(cpu, j, i);
+    }
+    free_cpu(cpu);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int threads = 1;
+    int arg = 1;
+    if (arg + 1 < argc && strcmp(argv[arg], "-j") == 0) {
+        threads = atoi(argv[arg + 1]);
+        arg += 2;
+    }
+    if (argc - arg < 1 || argc - arg > 2 || threads < 1 || threads > MAX_THREADS) {
+        printf("usage: %s [-j threads] keyframes.key [input.rec]\n", argv[0]);
+        exit(1);
+    }
+
+    keyframe_file *kf = keyframe_open(argv[arg]);
+    if (kf == NULL) {
+        printf("%s: not a keyframe file\n", argv[arg]);
+        exit(1);
+    }
+    if (kf->count < 2) {
+        printf("%s: %llu keyframes, nothing to replay between\n", argv[arg], (unsigned long long) kf->count);
+        exit(1);
+    }
+
+    input *recording = NULL;
+    if (arg + 1 < argc) {
+        recording = input_replay(argv[arg + 1]);
+        if (recording == NULL) {
+            printf("input_replay %s\n", argv[arg + 1]);
+            exit(1);
+        }
+    }
+
+    emu_cp_m_os = kf->header->flags & KEYFRAME_CPM;
+    if (emu_cp_m_os) {
+        threads = 1;
+    }
+
+    job j = {
+        .kf = kf,
+        .recording = recording,
+        .num_segments = kf->count - 1,
+        .segments = calloc(kf->count - 1, sizeof(segment)),
+    };
+    if ((uint64_t) threads > j.num_segments) {
+        threads = j.num_segments;
+    }
+
+    printf("keyframes: %s, %llu, every %u frames, rom crc32: %08x, base_addr: 0x%04x\n", argv[arg],
+        (unsigned long long) kf->count, kf->header->interval, kf->header->rom_crc32, kf->header->base_addr);
+    if (recording) {
+        printf("input: %s, %zu events\n", argv[arg + 1], recording->count);
+    }
+
+    const double start = now_seconds(CLOCK_MONOTONIC);
+    pthread_t pool[MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&pool[t], NULL, worker, &j);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(pool[t], NULL);
+    }
+    const double wall = now_seconds(CLOCK_MONOTONIC) - start;
+
+    uint64_t failed = 0;
+    double serial = 0;
+    for (uint64_t i = 0; i < j.num_segments; i++) {
+        const segment *s = &j.segments[i];
+        const keyframe *from = &kf->frames[i], *to = &kf->frames[i + 1];
+        serial += s->seconds;
+        if (s->result == SEGMENT_OK) continue;
+        failed++;
+        if (s->result == SEGMENT_DAMAGED) {
+            printf("segment %llu: keyframe at frame %llu doesn't match its hash\n", (unsigned long long) i,
+                (unsigned long long) from->frame);
+        } else {
+            printf("segment %llu: frames %llu-%llu, replay ends at %016llx, keyframe is %016llx\n",
+                (unsigned long long) i, (unsigned long long) from->frame, (unsigned long long) to->frame,
+                (unsigned long long) s->hash, (unsigned long long) to->hash);
+        }
+    }
+
+    const uint64_t frames = kf->frames[kf->count - 1].frame - kf->frames[0].frame;
+    printf("segments: %llu, frames: %llu, threads: %d, %.3f s (%.0f frames/s), %.3f s on one, %.2fx\n",
+        (unsigned long long) j.num_segments, (unsigned long long) frames, threads, wall,
+        wall > 0 ? frames / wall : 0.0, serial, wall > 0 ? serial / wall : 0.0);
+    printf("%s: %llu of %llu segments\n", failed ? "FAILED" : "ok",
+        (unsigned long long) (failed ? failed : j.num_segments), (unsigned long long) j.num_segments);
+
+    free(j.segments);
+    if (recording) {
+        input_close(recording);
+    }
+    keyframe_file_close(kf);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "trace.h"
+#include "disass.h"
+
+// Renders a binary trace written by trace.c as a disassembly listing.
+//
+// usage: emu-tracedump [trace.bin] [last_n]
+
+int main(int argc, char **argv) {
+    if (argc != 2 && argc != 3) {
+        printf("usage: %s [trace.bin] [last_n]\n", argv[0]);
+        exit(1);
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        printf("fopen %s\n", argv[1]);
+        exit(1);
+    }
+
+    trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1
+        || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0
+        || header.record_size != sizeof(trace_record)) {
+        printf("%s: not a trace file (or written by another version)\n", argv[1]);
+        exit(1);
+    }
+
+    if (argc == 3) {
+        // only the tail is interesting when the trace ran for hours
+        const long last_n = atol(argv[2]);
+        fseek(f, 0L, SEEK_END);
+        const long records = (ftell(f) - (long) sizeof(header)) / (long) sizeof(trace_record);
+        const long skip = records > last_n ? records - last_n : 0;
+        fseek(f, sizeof(header) + skip * sizeof(trace_record), SEEK_SET);
+    }
+
+    // disass() wants the instruction at its real address
+    static uint8_t mem[0x10000 + 2];
+    char line[DISASS_OP_SIZE];
+
+    trace_record r;
+    while (fread(&r, sizeof(r), 1, f) == 1) {
+        memcpy(&mem[r.pc], r.op, sizeof(r.op));
+        disass(line, mem, r.pc);
+
+        const flags *fl = (const flags*) &r.f;
+        printf("%12llu  %-32s A=%02x BC=%04x DE=%04x HL=%04x SP=%04x c:%x p:%x ac:%x z:%x s:%x\n",
+            (unsigned long long) r.cycles, line, r.A, r.BC, r.DE, r.HL, r.sp,
+            fl->carry, fl->parity, fl->auxcarry, fl->zero, fl->sign);
+    }
+
+    fclose(f);
+    return 0;
+}
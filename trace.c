@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+#define TRACE_WRITE_CHUNK 4096 // records per fwrite at most
+#define TRACE_IDLE_NS 1000000 // writer naps this long when the ring is empty
+
+// Writes out everything between tail and head, returns number of records.
+static uint64_t drain(tracer *t) {
+    const uint64_t head = atomic_load_explicit(&t->head, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    const uint64_t total = head - tail;
+
+    while (tail != head) {
+        const uint64_t idx = tail & (TRACE_RING_SIZE - 1);
+        uint64_t n = head - tail;
+        // don't run past the end of the ring, wrap on the next round
+        if (n > TRACE_RING_SIZE - idx) n = TRACE_RING_SIZE - idx;
+        if (n > TRACE_WRITE_CHUNK) n = TRACE_WRITE_CHUNK;
+
+        fwrite(&t->ring[idx], sizeof(trace_record), n, t->out);
+        tail += n;
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+
+    return total;
+}
+
+static void* writer_main(void *arg) {
+    tracer *t = arg;
+    const struct timespec idle = { 0, TRACE_IDLE_NS };
+
+    while (atomic_load_explicit(&t->running, memory_order_acquire)) {
+        if (drain(t) == 0) {
+            nanosleep(&idle, NULL);
+        }
+    }
+    // the emulation thread has stopped producing, flush the remainder
+    drain(t);
+    return NULL;
+}
+
+tracer* trace_open(const char *path) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        return NULL;
+    }
+
+    trace_header header = { .record_size = sizeof(trace_record) };
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, out) != 1) {
+        fclose(out);
+        return NULL;
+    }
+
+    tracer *t = calloc(sizeof(tracer), 1);
+    if (t == NULL) {
+        fclose(out);
+        return NULL;
+    }
+    t->out = out;
+    atomic_store(&t->running, true);
+    if (pthread_create(&t->writer, NULL, writer_main, t) != 0) {
+        fclose(out);
+        free(t);
+        return NULL;
+    }
+    return t;
+}
+
+void trace_close(tracer *t) {
+    atomic_store_explicit(&t->running, false, memory_order_release);
+    pthread_join(t->writer, NULL);
+
+    if (t->dropped > 0) {
+        printf("trace: dropped %llu records, writer couldn't keep up\n", (unsigned long long) t->dropped);
+    }
+    fclose(t->out);
+    free(t);
+}
@@ -0,0 +1,81 @@
+#ifndef trace_h
+#define trace_h
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "cpu.h"
+
+// Low overhead execution trace. Every traced instruction becomes a fixed
+// size binary record pushed into a single producer/single consumer ring,
+// a background thread drains the ring to disk. The emulation thread never
+// blocks: if the writer falls behind, records are dropped and counted.
+// Use tools/tracedump.c to turn the file back into a disassembly listing.
+
+#define TRACE_MAGIC "8080TRC1"
+#define TRACE_RING_SIZE (1 << 16) // records, must be a power of 2
+
+// Registers *before* the instruction at pc executes.
+typedef struct {
+    uint64_t cycles;
+    uint16_t pc;
+    uint16_t sp;
+    uint16_t BC;
+    uint16_t DE;
+    uint16_t HL;
+    uint8_t op[3]; // opcode + operands, enough to disassemble offline
+    uint8_t A;
+    uint8_t f;
+    uint8_t pad;
+} trace_record;
+
+typedef struct {
+    uint8_t magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+} trace_header;
+
+typedef struct {
+    trace_record ring[TRACE_RING_SIZE];
+    _Atomic uint64_t head; // written by the emulation thread only
+    _Atomic uint64_t tail; // written by the writer thread only
+    uint64_t cached_tail; // producer's last view of tail
+    uint64_t dropped;
+
+    FILE *out;
+    pthread_t writer;
+    _Atomic bool running;
+} tracer;
+
+tracer* trace_open(const char *path);
+void trace_close(tracer *t);
+
+static inline void trace_exec(tracer *t, const CPU *cpu) {
+    const uint64_t head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (head - t->cached_tail == TRACE_RING_SIZE) {
+        t->cached_tail = atomic_load_explicit(&t->tail, memory_order_acquire);
+        if (head - t->cached_tail == TRACE_RING_SIZE) {
+            t->dropped++;
+            return;
+        }
+    }
+
+    trace_record *r = &t->ring[head & (TRACE_RING_SIZE - 1)];
+    r->cycles = cpu->cycles;
+    r->pc = cpu->pc;
+    r->sp = cpu->sp;
+    r->BC = cpu->BC;
+    r->DE = cpu->DE;
+    r->HL = cpu->HL;
+    r->op[0] = cpu->mem[cpu->pc];
+    r->op[1] = cpu->mem[(uint16_t) (cpu->pc + 1)];
+    r->op[2] = cpu->mem[(uint16_t) (cpu->pc + 2)];
+    r->A = cpu->A;
+    r->f = *(const uint8_t*) &cpu->f;
+    r->pad = 0;
+
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
+
+#endif